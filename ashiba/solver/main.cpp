@@ -1,10 +1,10 @@
-#include "galaxy.hpp"
+#include "galaxy_trajectory.hpp"
+#include "galaxy_scheduler.hpp"
 
 #include <algorithm>
 #include <cmath>
 #include <vector>
 #include <queue>
-#include <set>
 
 const double PI = 3.1415926535;
 const double EPS = 1e-9;
@@ -29,84 +29,29 @@ if (prms.x0 * 1
 }
 
 
-const int PLANET_R = 16;
-galaxy::Vec calcGravity(const galaxy::Vec& pos) {
-	const int ddx = pos.x < -PLANET_R ? 1 : -1;
-	const int ddy = pos.y < -PLANET_R ? 1 : -1;
-
-	if (-PLANET_R <= pos.x and pos.x <= PLANET_R) return galaxy::Vec(0, ddy);
-	if (-PLANET_R <= pos.y and pos.y <= PLANET_R) return galaxy:: Vec(ddx, 0);
-
-	const int diffx = std::min(abs(pos.x - PLANET_R), abs(pos.x - (-PLANET_R)));
-	const int diffy = std::min(abs(pos.y - PLANET_R), abs(pos.y - (-PLANET_R)));
-
-	if (diffx > diffx) return galaxy::Vec(ddx, 0);
-	else if (diffx < diffx) return galaxy::Vec(0, ddy);
-	else return galaxy::Vec(ddx, ddy);
-}
-
-galaxy::Vec calcNextVel(const galaxy::Vec& pos, const galaxy::Vec& vel) {
-	galaxy::Vec res = calcGravity(pos);
-	return galaxy::Vec(vel.x + res.x, vel.y + res.y);
-}
-
-galaxy::Vec calcNextPos(const galaxy::Vec& pos, const galaxy::Vec& vel) {
-	galaxy::Vec res = calcNextVel(pos, vel);
-	return galaxy::Vec(pos.x + res.x, pos.y + res.y);
-}
-
-std::vector<galaxy::Vec> predictFuturePos(const galaxy::Vec& cur_pos, const galaxy::Vec& cur_vel, const int& times) {
-	std::vector<galaxy::Vec> positions(times+1);
-	std::vector<galaxy::Vec> velocities(times+1);
-	positions[0] = cur_pos;
-	velocities[0] = cur_vel; 
-
-	for (int i=1; i<=times; ++i) {
-		velocities[i] = calcNextVel(positions[i-1], velocities[i-1]);
-		positions[i]  = calcNextPos(positions[i-1], velocities[i]);
-	}
-
-	return positions;
-}
-
 bool isGrayArea(galaxy::Vec vec) {
 	if (vec.x < -FIELD_RADIUS or vec.x > FIELD_RADIUS) return false;
 	if (vec.y < -FIELD_RADIUS or vec.y > FIELD_RADIUS) return false;
 	return true;
 }
 
-bool isIntoOrbit(const galaxy::Vec& pos, const galaxy::Vec& vel) {
-	std::vector<galaxy::Vec> pos_vec = predictFuturePos(pos, vel, 100);
-
-	auto comparison_func = [](const galaxy::Vec& a, const galaxy::Vec& b) { return std::make_pair(a.x, a.y) < std::make_pair(b.x, b.y); };
-	std::set<galaxy::Vec, std::function<bool (const galaxy::Vec&, const galaxy::Vec&)>> visited(comparison_func);
-	std::vector<bool> is_second_visit(pos_vec.size(), false);
-	for (int i=0; i<pos_vec.size(); ++i) {
-		is_second_visit[i] = visited.count(pos_vec[i]) == 0 ? false : true;
-		visited.insert(pos_vec[i]);
-	}
+const int MAX_SEARCH_DEPTH = 16;
+const int ORBIT_CHECK_STEPS = 100;
+const auto TURN_BUDGET = std::chrono::milliseconds(100);
 
-	int back_second_visit_count = 0;
-	for (int i=is_second_visit.size()-1; i>=0; --i) {
-		if (is_second_visit[i]) back_second_visit_count++;
-		else break;
-	}
-
-
-	// std::cerr << pos_vec.size() << std::endl;
-	// for (const auto& elm: pos_vec) {
-	// 	std::cerr << elm.x << " " << elm.y << std::endl;
-	// }
-	
-	for (const auto& elm: pos_vec) {
-		if (abs(elm.x) < 16 or abs(elm.y) < 16 ) return false;
-	}
-	return (back_second_visit_count >=3);
+bool isIntoOrbit(const galaxy::Vec& pos, const galaxy::Vec& vel) {
+	static const galaxy::OrbitClassifier classifier(FIELD_RADIUS, PLANET_RADIUS, ORBIT_CHECK_STEPS);
+	return classifier(pos, vel).periodic();
 }
 
-void dfs(const int depth, const galaxy::Vec& pos, const galaxy::Vec& vel, std::vector<galaxy::Vec>& move, bool& solved) {
-	if (solved) return ;
-	if (depth >= 6) {
+void dfs(const int depth, const int max_depth, const galaxy::TurnScheduler::clock::time_point deadline,
+         const galaxy::Vec& pos, const galaxy::Vec& vel, std::vector<galaxy::Vec>& move, bool& solved, bool& timed_out) {
+	if (solved or timed_out) return ;
+	if (galaxy::TurnScheduler::clock::now() >= deadline) {
+		timed_out = true;
+		return ;
+	}
+	if (depth >= max_depth) {
 		// for (const auto& elm: move) {
 		// 	std::cout << "(" << elm.x << ", " << elm.y << "), ";
 		// }
@@ -123,30 +68,61 @@ void dfs(const int depth, const galaxy::Vec& pos, const galaxy::Vec& vel, std::v
 		const int dx = i%3 - 1;
 		const int dy = i/3 - 1;
 		
+		// accel(d) changes the velocity by -d
+		const auto next = galaxy::rules::simulate(pos, galaxy::Vec(vel.x - dx, vel.y - dy));
+		const long r = std::max(std::abs(next.first.x), std::abs(next.first.y));
+		if (r <= PLANET_RADIUS or r > FIELD_RADIUS) continue;
+
 		move.push_back(galaxy::Vec(dx, dy));
-		galaxy::Vec next_vel = calcNextVel(pos, vel);
-		next_vel = galaxy::Vec(next_vel.x+dx, next_vel.y+dy);
-		galaxy::Vec next_pos = calcNextPos(pos, next_vel);
-		dfs(depth+1, next_pos, next_vel, move, solved);
+		dfs(depth+1, max_depth, deadline, next.first, next.second, move, solved, timed_out);
+		if (solved or timed_out) return ;
 		move.pop_back();
 	}
 }
 
-std::queue<galaxy::Vec> getFutureMove(const galaxy::Vec& pos, const galaxy::Vec& vel) {
-	std::vector<galaxy::Vec> move;
-	int depth = 0;
-	bool solved = false;
-	dfs(depth, pos, vel, move, solved);
-
-	if (solved == false) {
-		std::cerr << "solution not found" << std::endl;
-		return std::queue<galaxy::Vec>();
+struct FutureMoves {
+	std::vector<std::vector<galaxy::Vec>> move;
+	std::vector<bool> solved;
+};
+
+// iterative deepening over all ships (pos, vel) until the turn budget runs out.
+// ships solved at a shallower depth keep their moves in deeper iterations.
+std::vector<std::queue<galaxy::Vec>> getFutureMoves(const std::vector<std::pair<galaxy::Vec, galaxy::Vec>>& ships,
+                                                    const galaxy::GalaxyContext& ctx, galaxy::TurnScheduler& scheduler) {
+	FutureMoves done;  // of the last complete iteration
+	done.move.resize(ships.size());
+	done.solved.assign(ships.size(), false);
+	const auto search = [&](long max_depth, galaxy::TurnScheduler::clock::time_point deadline, FutureMoves& result) {
+		result = done;
+		bool all_solved = true;
+		for (size_t i=0; i<ships.size(); ++i) {
+			if (result.solved[i]) continue;
+			std::vector<galaxy::Vec> move;
+			bool solved = false, timed_out = false;
+			dfs(0, max_depth, deadline, ships[i].first, ships[i].second, move, solved, timed_out);
+			if (timed_out) return galaxy::IterationResult::TIMED_OUT;
+			if (solved) {
+				result.move[i] = move;
+				result.solved[i] = true;
+			} else {
+				all_solved = false;
+			}
+		}
+		done = result;
+		return all_solved ? galaxy::IterationResult::DONE : galaxy::IterationResult::DEEPER;
+	};
+	const FutureMoves moves = scheduler.run(ctx, search, done, MAX_SEARCH_DEPTH);
+	std::cerr << "searched " << ships.size() << " ships to depth " << scheduler.depth() << std::endl;
+
+	std::vector<std::queue<galaxy::Vec>> ret(ships.size());
+	for (size_t i=0; i<ships.size(); ++i) {
+		if (moves.solved[i] == false) {
+			std::cerr << "solution not found" << std::endl;
+			continue;
+		}
+		for (const auto& elm: moves.move[i]) ret[i].push(elm);
+		std::cerr << "solution found" << std::endl;
 	}
-
-	std::queue<galaxy::Vec> ret;
-	for (const auto& elm: move) ret.push(elm);
-
-	std::cerr << "solution found" << std::endl;
 	return ret;
 }
 
@@ -182,6 +158,7 @@ int main(int argc, char *argv[]){
 		assert(isShipParamsValid(ship_params) == true);
 		res = ctx.start(ship_params);
 
+		galaxy::TurnScheduler scheduler(TURN_BUDGET);
 		std::vector<std::queue<galaxy::Vec>> future_move;
 		std::vector<bool> isShipIntoOrbit;
 
@@ -189,20 +166,36 @@ int main(int argc, char *argv[]){
 		while(res.stage == galaxy::GameStage::RUNNING){
 			int count = 0;
 			res.dump(std::cerr);
-			galaxy::CommandListBuilder cmds;
+
+			// one scheduled search per turn for every ship not yet into orbit
+			std::vector<long> search_ids;
+			std::vector<std::pair<galaxy::Vec, galaxy::Vec>> search_ships;
 			for(const auto& sac : res.state.ships){
 				const auto& ship = sac.ship;
 				if(ship.role != res.static_info.self_role){ continue; }
 				if(ship.params.x0 <= 50){ continue; }  // TODO
-
 				if (isShipIntoOrbit.size() <= ship.id or isShipIntoOrbit[ship.id] == false) {
-					std::queue<galaxy::Vec> que = getFutureMove(ship.pos, ship.vel);
-					while (future_move.size() <= ship.id)  future_move.emplace_back(std::queue<galaxy::Vec>());
-					while (isShipIntoOrbit.size() <= ship.id) isShipIntoOrbit.push_back(false);
-
-					future_move[ship.id] = que;
-					isShipIntoOrbit[ship.id] = true;
+					search_ids.push_back(ship.id);
+					search_ships.emplace_back(ship.pos, ship.vel);
+				}
+			}
+			if (not search_ships.empty()) {
+				const auto ques = getFutureMoves(search_ships, ctx, scheduler);
+				for (size_t i=0; i<search_ids.size(); ++i) {
+					const long id = search_ids[i];
+					while (future_move.size() <= id)  future_move.emplace_back(std::queue<galaxy::Vec>());
+					while (isShipIntoOrbit.size() <= id) isShipIntoOrbit.push_back(false);
+
+					future_move[id] = ques[i];
+					isShipIntoOrbit[id] = true;
 				}
+			}
+
+			galaxy::CommandListBuilder cmds;
+			for(const auto& sac : res.state.ships){
+				const auto& ship = sac.ship;
+				if(ship.role != res.static_info.self_role){ continue; }
+				if(ship.params.x0 <= 50){ continue; }  // TODO
 
 				std::cerr << "------------" << future_move[ship.id].size() << std::endl;
 				if (not future_move[ship.id].empty()) {
@@ -15,8 +15,10 @@
 const int UNIVERSE_CHECK_ITERATIONS = 15;
 const double RELATIVE_ANGLE_THRESHOLD = 0.2;
 
-std::random_device seed_gen;
-std::mt19937 engine(seed_gen());
+// GALAXY_SEED makes runs reproducible (set by libgalaxy/example/tournament.cpp)
+std::mt19937 engine(std::getenv("GALAXY_SEED")
+	? std::strtoul(std::getenv("GALAXY_SEED"), nullptr, 10)
+	: std::random_device()());
 
 using Vec = galaxy::Vec;
 
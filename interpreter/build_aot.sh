@@ -0,0 +1,28 @@
+#!/bin/sh
+# Translates a galaxy program into C++ and builds a standalone interpreter.
+# usage: ./build_aot.sh galaxy.txt [output] [--root name]...
+
+set -e
+
+if [ $# -lt 1 ]; then
+	echo "usage: $0 program [output] [--root name]..." >&2
+	exit 1
+fi
+
+dir=$(cd "$(dirname "$0")" && pwd)
+program=$1
+shift
+output=galaxy_aot
+if [ $# -gt 0 ]; then
+	case "$1" in
+		--*) ;;
+		*) output=$1; shift ;;
+	esac
+fi
+
+work=$(mktemp -d)
+trap 'rm -rf "$work"' EXIT
+
+g++ -std=c++14 -O2 -pthread -o "$work/translate" "$dir/main.cpp" -lcurl
+"$work/translate" "$program" "$@" --emit-cpp "$work/galaxy_aot.cpp"
+g++ -std=c++14 -O2 -pthread -I"$dir" -o "$output" "$work/galaxy_aot.cpp" -lcurl
@@ -0,0 +1,2983 @@
+// Galaxy interpreter as a header-only library.
+// Create an Interpreter, load a program and evaluate expressions through it;
+// main.cpp is the REPL built on top of this API.
+#ifndef GALAXY_INTERPRETER_HPP
+#define GALAXY_INTERPRETER_HPP
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <unordered_map>
+#include <set>
+#include <queue>
+#include <deque>
+#include <memory>
+#include <array>
+#include <algorithm>
+#include <stdexcept>
+#include <climits>
+#include <cstdint>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <exception>
+#include <cstdlib>
+#include <cstring>
+#include <chrono>
+#include <typeinfo>
+#include <cxxabi.h>
+#include <sys/resource.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+extern "C" {
+#include <curl/curl.h>
+}
+
+#include "../libgalaxy/include/galaxy.hpp"
+
+class Object;
+using ObjectPtr = std::shared_ptr<Object>;
+
+enum class Kind {
+	OBJECT    = 0,
+	NUMBER    = 1,
+	REFERENCE = 2,
+	APPLY     = 3,
+};
+
+struct Node {
+	Kind kind;
+	long number;
+	std::string key;
+	std::shared_ptr<Node> fn;
+	std::shared_ptr<Node> arg;
+	ObjectPtr cache;
+};
+using NodePtr = std::shared_ptr<Node>;
+
+inline std::ostream& operator<<(std::ostream& os, Node& node){
+	// Walks with an explicit stack: long application chains must not overflow the call stack
+	std::vector<std::pair<const Node*, const char*>> stack(1, std::make_pair(&node, nullptr));
+	while(!stack.empty()){
+		const auto top = stack.back();
+		stack.pop_back();
+		if(!top.first){
+			os << top.second;
+		}else if(top.first->kind == Kind::NUMBER){
+			os << top.first->number;
+		}else if(top.first->kind == Kind::REFERENCE){
+			os << top.first->key;
+		}else if(top.first->kind == Kind::APPLY){
+			stack.emplace_back(nullptr, ")");
+			stack.emplace_back(top.first->arg.get(), nullptr);
+			stack.emplace_back(nullptr, "(");
+			stack.emplace_back(top.first->fn.get(), nullptr);
+		}
+	}
+	return os;
+}
+
+//----------------------------------------------------------------------------
+// Telemetry
+//----------------------------------------------------------------------------
+// Allocation counters per class, cached thunks and interaction steps.
+// Reported by the :stats command and optionally logged as NDJSON, one record per command.
+class Telemetry {
+public:
+	// Updated concurrently while program files are parsed on several threads
+	struct Counter {
+		std::string name;
+		size_t size;
+		std::atomic<size_t> allocated;
+		std::atomic<size_t> live;
+		Counter(std::string name, size_t size)
+			: name(std::move(name)), size(size), allocated(0), live(0) { }
+	};
+	struct Snapshot {
+		size_t allocated;
+		size_t allocated_bytes;
+		size_t live;
+		size_t live_bytes;
+		size_t cached_thunks;
+		size_t interact_steps;
+	};
+
+private:
+	std::deque<Counter> m_counters;
+	mutable std::mutex m_counters_mutex;
+	std::atomic<size_t> m_cached_thunks;
+	std::atomic<size_t> m_interact_steps;
+	std::ofstream m_log;
+
+	static std::string demangle(const char *name){
+		int status = 0;
+		char *demangled = abi::__cxa_demangle(name, nullptr, nullptr, &status);
+		std::string result = (status == 0 && demangled) ? demangled : name;
+		std::free(demangled);
+		return result;
+	}
+
+	static std::string escape(const std::string& s){
+		std::ostringstream oss;
+		for(const char c : s){
+			if(c == '"' || c == '\\'){
+				oss << '\\' << c;
+			}else if(static_cast<unsigned char>(c) < 0x20){
+				oss << "\\u00" << "0123456789abcdef"[(c >> 4) & 15] << "0123456789abcdef"[c & 15];
+			}else{
+				oss << c;
+			}
+		}
+		return oss.str();
+	}
+
+public:
+	Telemetry()
+		: m_counters()
+		, m_counters_mutex()
+		, m_cached_thunks(0)
+		, m_interact_steps(0)
+		, m_log()
+	{ }
+
+	static Telemetry& instance(){
+		static Telemetry telemetry;
+		return telemetry;
+	}
+
+	Counter& add_counter(const char *mangled_name, size_t size){
+		std::lock_guard<std::mutex> lock(m_counters_mutex);
+		m_counters.emplace_back(demangle(mangled_name), size);
+		return m_counters.back();
+	}
+
+	void thunk_cached(){ m_cached_thunks.fetch_add(1, std::memory_order_relaxed); }
+	void thunk_released(){ m_cached_thunks.fetch_sub(1, std::memory_order_relaxed); }
+	void interact_step(){ m_interact_steps.fetch_add(1, std::memory_order_relaxed); }
+
+	Snapshot snapshot() const {
+		Snapshot s = {
+			0, 0, 0, 0,
+			m_cached_thunks.load(std::memory_order_relaxed),
+			m_interact_steps.load(std::memory_order_relaxed)
+		};
+		std::lock_guard<std::mutex> lock(m_counters_mutex);
+		for(const auto& c : m_counters){
+			const size_t allocated = c.allocated.load(std::memory_order_relaxed);
+			const size_t live      = c.live.load(std::memory_order_relaxed);
+			s.allocated       += allocated;
+			s.allocated_bytes += allocated * c.size;
+			s.live            += live;
+			s.live_bytes      += live * c.size;
+		}
+		return s;
+	}
+
+	// Peak resident set size in KiB
+	static long peak_rss(){
+		struct rusage usage;
+		if(getrusage(RUSAGE_SELF, &usage) != 0){ return -1; }
+		return usage.ru_maxrss;
+	}
+
+	void open_log(const std::string& path){
+		m_log.open(path, std::ios::app);
+		if(!m_log){ throw std::runtime_error("cannot open stats log: " + path); }
+	}
+
+	void write_report(std::ostream& os) const {
+		std::vector<const Counter*> counters;
+		{
+			std::lock_guard<std::mutex> lock(m_counters_mutex);
+			for(const auto& c : m_counters){ counters.push_back(&c); }
+		}
+		const auto bytes = [](const Counter *c){ return c->allocated.load(std::memory_order_relaxed) * c->size; };
+		std::sort(counters.begin(), counters.end(), [&](const Counter *a, const Counter *b){
+			return bytes(a) > bytes(b);
+		});
+		os << "class\tsize\tallocated\tlive\tlive bytes" << std::endl;
+		for(const auto c : counters){
+			const size_t live = c->live.load(std::memory_order_relaxed);
+			os << c->name << "\t" << c->size << "\t" << c->allocated.load(std::memory_order_relaxed) << "\t"
+			   << live << "\t" << live * c->size << std::endl;
+		}
+		const auto s = snapshot();
+		os << "total\t-\t" << s.allocated << "\t" << s.live << "\t" << s.live_bytes << std::endl;
+		os << "cached thunks: " << s.cached_thunks << std::endl;
+		os << "interact steps: " << s.interact_steps << std::endl;
+		os << "peak RSS: " << peak_rss() << " KiB" << std::endl;
+	}
+
+	void log_command(const std::string& command, const Snapshot& before, double elapsed_ms){
+		if(!m_log.is_open()){ return; }
+		const auto after = snapshot();
+		const size_t bytes = after.allocated_bytes - before.allocated_bytes;
+		const size_t steps = after.interact_steps - before.interact_steps;
+		m_log << "{\"command\":\"" << escape(command) << "\""
+		      << ",\"elapsed_ms\":" << elapsed_ms
+		      << ",\"allocated\":" << after.allocated - before.allocated
+		      << ",\"allocated_bytes\":" << bytes
+		      << ",\"live\":" << after.live
+		      << ",\"live_bytes\":" << after.live_bytes
+		      << ",\"cached_thunks\":" << after.cached_thunks
+		      << ",\"interact_steps\":" << steps
+		      << ",\"bytes_per_interact\":" << (steps > 0 ? bytes / steps : 0)
+		      << ",\"peak_rss_kib\":" << peak_rss() << "}" << std::endl;
+	}
+};
+
+template <typename T>
+inline Telemetry::Counter& allocation_counter(){
+	static Telemetry::Counter& counter = Telemetry::instance().add_counter(typeid(T).name(), sizeof(T));
+	return counter;
+}
+
+template <typename T> inline void on_release(const T&){ }
+
+inline void on_release(const Node& node){
+	if(node.kind != Kind::OBJECT && node.cache){ Telemetry::instance().thunk_released(); }
+}
+
+// Wraps T to keep its allocation counter up to date
+template <typename T>
+class Counted : public T {
+public:
+	template <typename... Args>
+	explicit Counted(Args&&... args) : T(std::forward<Args>(args)...) {
+		auto& counter = allocation_counter<T>();
+		counter.allocated.fetch_add(1, std::memory_order_relaxed);
+		counter.live.fetch_add(1, std::memory_order_relaxed);
+	}
+	~Counted(){
+		on_release(static_cast<const T&>(*this));
+		allocation_counter<T>().live.fetch_sub(1, std::memory_order_relaxed);
+	}
+};
+
+template <typename T, typename... Args>
+inline std::shared_ptr<T> make_counted(Args&&... args){
+	return std::make_shared<Counted<T>>(std::forward<Args>(args)...);
+}
+
+// Measures one REPL command and appends it to the stats log
+class CommandScope {
+private:
+	std::string m_command;
+	Telemetry::Snapshot m_before;
+	std::chrono::steady_clock::time_point m_start;
+public:
+	explicit CommandScope(std::string command)
+		: m_command(std::move(command))
+		, m_before(Telemetry::instance().snapshot())
+		, m_start(std::chrono::steady_clock::now())
+	{ }
+	~CommandScope(){
+		const auto elapsed = std::chrono::steady_clock::now() - m_start;
+		Telemetry::instance().log_command(m_command, m_before, std::chrono::duration<double, std::milli>(elapsed).count());
+	}
+};
+
+//----------------------------------------------------------------------------
+// Arbitrary precision integers
+//----------------------------------------------------------------------------
+class BigInt {
+private:
+	bool m_negative;
+	std::vector<uint32_t> m_digits;  // magnitude in base 2^32, little endian
+
+	void trim(){
+		while(!m_digits.empty() && m_digits.back() == 0){ m_digits.pop_back(); }
+		if(m_digits.empty()){ m_negative = false; }
+	}
+
+	static int compare_abs(const std::vector<uint32_t>& a, const std::vector<uint32_t>& b){
+		if(a.size() != b.size()){ return a.size() < b.size() ? -1 : 1; }
+		for(size_t i = a.size(); i > 0; --i){
+			if(a[i - 1] != b[i - 1]){ return a[i - 1] < b[i - 1] ? -1 : 1; }
+		}
+		return 0;
+	}
+
+	static std::vector<uint32_t> add_abs(const std::vector<uint32_t>& a, const std::vector<uint32_t>& b){
+		std::vector<uint32_t> c(std::max(a.size(), b.size()) + 1, 0);
+		uint64_t carry = 0;
+		for(size_t i = 0; i + 1 < c.size(); ++i){
+			const uint64_t t = carry + (i < a.size() ? a[i] : 0) + (i < b.size() ? b[i] : 0);
+			c[i]  = static_cast<uint32_t>(t);
+			carry = t >> 32;
+		}
+		c.back() = static_cast<uint32_t>(carry);
+		return c;
+	}
+
+	// requires |a| >= |b|
+	static std::vector<uint32_t> sub_abs(const std::vector<uint32_t>& a, const std::vector<uint32_t>& b){
+		std::vector<uint32_t> c(a.size(), 0);
+		int64_t borrow = 0;
+		for(size_t i = 0; i < a.size(); ++i){
+			int64_t t = static_cast<int64_t>(a[i]) - borrow - (i < b.size() ? b[i] : 0);
+			borrow = (t < 0);
+			if(t < 0){ t += (int64_t(1) << 32); }
+			c[i] = static_cast<uint32_t>(t);
+		}
+		return c;
+	}
+
+	static BigInt add_signed(const BigInt& a, const BigInt& b, bool b_negative){
+		BigInt c;
+		if(a.m_negative == b_negative){
+			c.m_digits   = add_abs(a.m_digits, b.m_digits);
+			c.m_negative = a.m_negative;
+		}else if(compare_abs(a.m_digits, b.m_digits) >= 0){
+			c.m_digits   = sub_abs(a.m_digits, b.m_digits);
+			c.m_negative = a.m_negative;
+		}else{
+			c.m_digits   = sub_abs(b.m_digits, a.m_digits);
+			c.m_negative = b_negative;
+		}
+		c.trim();
+		return c;
+	}
+
+	void shift_left_one(){
+		uint32_t carry = 0;
+		for(auto& d : m_digits){
+			const uint32_t next = d >> 31;
+			d = (d << 1) | carry;
+			carry = next;
+		}
+		if(carry){ m_digits.push_back(carry); }
+	}
+
+public:
+	BigInt() : m_negative(false), m_digits() { }
+
+	explicit BigInt(long x) : m_negative(x < 0), m_digits() {
+		unsigned long y = (x < 0) ? (0ul - static_cast<unsigned long>(x)) : static_cast<unsigned long>(x);
+		while(y != 0){
+			m_digits.push_back(static_cast<uint32_t>(y));
+			y >>= 32;
+		}
+	}
+
+	static BigInt from_string(const std::string& s){
+		BigInt x;
+		size_t i = (s[0] == '-' || s[0] == '+') ? 1 : 0;
+		for(; i < s.size(); ++i){
+			if(!std::isdigit(s[i])){ throw std::runtime_error("invalid number: " + s); }
+			uint64_t carry = s[i] - '0';
+			for(auto& d : x.m_digits){
+				const uint64_t t = static_cast<uint64_t>(d) * 10 + carry;
+				d = static_cast<uint32_t>(t);
+				carry = t >> 32;
+			}
+			if(carry){ x.m_digits.push_back(static_cast<uint32_t>(carry)); }
+		}
+		x.m_negative = (s[0] == '-');
+		x.trim();
+		return x;
+	}
+
+	bool is_negative() const { return m_negative; }
+	bool is_zero() const { return m_digits.empty(); }
+
+	bool fits_long() const {
+		if(m_digits.size() > 2){ return false; }
+		const unsigned long y = magnitude();
+		const unsigned long limit = static_cast<unsigned long>(LONG_MAX);
+		return m_negative ? (y <= limit + 1) : (y <= limit);
+	}
+
+	unsigned long magnitude() const {
+		unsigned long y = 0;
+		for(size_t i = std::min<size_t>(m_digits.size(), 2); i > 0; --i){
+			y = (y << 32) | m_digits[i - 1];
+		}
+		return y;
+	}
+
+	long to_long() const {
+		const unsigned long y = magnitude();
+		return m_negative ? static_cast<long>(0ul - y) : static_cast<long>(y);
+	}
+
+	size_t bit_length() const {
+		if(m_digits.empty()){ return 0; }
+		return m_digits.size() * 32 - __builtin_clz(m_digits.back());
+	}
+
+	bool bit(size_t i) const {
+		const size_t k = i / 32;
+		return k < m_digits.size() && ((m_digits[k] >> (i % 32)) & 1);
+	}
+
+	void set_bit(size_t i){
+		const size_t k = i / 32;
+		if(m_digits.size() <= k){ m_digits.resize(k + 1, 0); }
+		m_digits[k] |= (1u << (i % 32));
+	}
+
+	BigInt operator-() const {
+		BigInt x(*this);
+		x.m_negative = !m_negative;
+		x.trim();
+		return x;
+	}
+
+	friend BigInt operator+(const BigInt& a, const BigInt& b){
+		return add_signed(a, b, b.m_negative);
+	}
+
+	friend BigInt operator-(const BigInt& a, const BigInt& b){
+		return add_signed(a, b, !b.m_negative);
+	}
+
+	friend BigInt operator*(const BigInt& a, const BigInt& b){
+		BigInt c;
+		c.m_digits.assign(a.m_digits.size() + b.m_digits.size(), 0);
+		for(size_t i = 0; i < a.m_digits.size(); ++i){
+			uint64_t carry = 0;
+			for(size_t j = 0; j < b.m_digits.size(); ++j){
+				const uint64_t t = static_cast<uint64_t>(a.m_digits[i]) * b.m_digits[j] + c.m_digits[i + j] + carry;
+				c.m_digits[i + j] = static_cast<uint32_t>(t);
+				carry = t >> 32;
+			}
+			c.m_digits[i + b.m_digits.size()] = static_cast<uint32_t>(carry);
+		}
+		c.m_negative = (a.m_negative != b.m_negative);
+		c.trim();
+		return c;
+	}
+
+	// Truncates toward zero like the built-in integer division
+	friend BigInt operator/(const BigInt& a, const BigInt& b){
+		if(b.is_zero()){ throw std::runtime_error("division by zero"); }
+		BigInt q, r;
+		for(size_t i = a.bit_length(); i > 0; --i){
+			r.shift_left_one();
+			if(a.bit(i - 1)){
+				if(r.m_digits.empty()){ r.m_digits.push_back(0); }
+				r.m_digits[0] |= 1;
+			}
+			if(compare_abs(r.m_digits, b.m_digits) >= 0){
+				r.m_digits = sub_abs(r.m_digits, b.m_digits);
+				r.trim();
+				q.set_bit(i - 1);
+			}
+		}
+		q.m_negative = (a.m_negative != b.m_negative);
+		q.trim();
+		return q;
+	}
+
+	friend bool operator==(const BigInt& a, const BigInt& b){
+		return a.m_negative == b.m_negative && a.m_digits == b.m_digits;
+	}
+
+	friend bool operator<(const BigInt& a, const BigInt& b){
+		if(a.m_negative != b.m_negative){ return a.m_negative; }
+		const int c = compare_abs(a.m_digits, b.m_digits);
+		return a.m_negative ? (c > 0) : (c < 0);
+	}
+
+	std::string to_string() const {
+		if(m_digits.empty()){ return "0"; }
+		std::vector<uint32_t> cur(m_digits);
+		std::string s;
+		while(!cur.empty()){
+			uint64_t rem = 0;
+			for(size_t i = cur.size(); i > 0; --i){
+				const uint64_t t = (rem << 32) | cur[i - 1];
+				cur[i - 1] = static_cast<uint32_t>(t / 1000000000);
+				rem = t % 1000000000;
+			}
+			while(!cur.empty() && cur.back() == 0){ cur.pop_back(); }
+			for(int i = 0; i < 9; ++i){
+				s.push_back('0' + rem % 10);
+				rem /= 10;
+				if(cur.empty() && rem == 0){ break; }
+			}
+		}
+		if(m_negative){ s.push_back('-'); }
+		return std::string(s.rbegin(), s.rend());
+	}
+};
+
+ObjectPtr make_number(BigInt x);
+
+//----------------------------------------------------------------------------
+// Parser
+//----------------------------------------------------------------------------
+enum class Builtin {
+	NONE, INC, DEC, ADD, MUL, DIV, EQ, LT, MOD, DEM, SEND, NEG, S, C, B, T, F, I,
+	CONS, CAR, CDR, NIL, ISNIL, IF0, INTERACT, AP
+};
+
+// Perfect hash over the reserved words: (length, one or two characters)
+// identifies at most one candidate, which is then compared in full.
+inline Builtin lookup_builtin(const char *s, size_t n){
+#define GALAXY_PAIR(a, b) ((static_cast<unsigned>(a) << 8) | static_cast<unsigned>(b))
+	auto match = [&](const char *word, Builtin b){
+		return std::equal(s, s + n, word) ? b : Builtin::NONE;
+	};
+	switch(n){
+	case 1:
+		switch(s[0]){
+		case 's': return Builtin::S;
+		case 'c': return Builtin::C;
+		case 'b': return Builtin::B;
+		case 't': return Builtin::T;
+		case 'f': return Builtin::F;
+		case 'i': return Builtin::I;
+		}
+		break;
+	case 2:
+		switch(s[0]){
+		case 'a': return match("ap", Builtin::AP);
+		case 'e': return match("eq", Builtin::EQ);
+		case 'l': return match("lt", Builtin::LT);
+		}
+		break;
+	case 3:
+		switch(GALAXY_PAIR(s[1], s[2])){
+		case GALAXY_PAIR('n', 'c'): return match("inc", Builtin::INC);
+		case GALAXY_PAIR('e', 'c'): return match("dec", Builtin::DEC);
+		case GALAXY_PAIR('d', 'd'): return match("add", Builtin::ADD);
+		case GALAXY_PAIR('u', 'l'): return match("mul", Builtin::MUL);
+		case GALAXY_PAIR('i', 'v'): return match("div", Builtin::DIV);
+		case GALAXY_PAIR('o', 'd'): return match("mod", Builtin::MOD);
+		case GALAXY_PAIR('e', 'm'): return match("dem", Builtin::DEM);
+		case GALAXY_PAIR('e', 'g'): return match("neg", Builtin::NEG);
+		case GALAXY_PAIR('a', 'r'): return match("car", Builtin::CAR);
+		case GALAXY_PAIR('d', 'r'): return match("cdr", Builtin::CDR);
+		case GALAXY_PAIR('i', 'l'): return match("nil", Builtin::NIL);
+		case GALAXY_PAIR('f', '0'): return match("if0", Builtin::IF0);
+		}
+		break;
+	case 4:
+		switch(s[0]){
+		case 's': return match("send", Builtin::SEND);
+		case 'c': return match("cons", Builtin::CONS);
+		}
+		break;
+	case 5: return match("isnil", Builtin::ISNIL);
+	case 8: return match("interact", Builtin::INTERACT);
+	}
+	return Builtin::NONE;
+#undef GALAXY_PAIR
+}
+
+inline Builtin lookup_builtin(const std::string& s){ return lookup_builtin(s.data(), s.size()); }
+
+inline bool is_builtin(const std::string& s){
+	const auto b = lookup_builtin(s);
+	return b != Builtin::NONE && b != Builtin::AP;
+}
+
+// Splits a character range into whitespace separated tokens.
+// Tokens point into the range; nothing is copied or allocated.
+class Tokenizer {
+public:
+	struct Token {
+		const char *data;
+		size_t size;
+		std::string str() const { return std::string(data, size); }
+	};
+
+private:
+	const char *m_cur;
+	const char *m_end;
+
+	static bool is_space(char c){
+		return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\v' || c == '\f';
+	}
+
+public:
+	Tokenizer(const char *first, const char *last)
+		: m_cur(first)
+		, m_end(last)
+	{ }
+	explicit Tokenizer(const std::string& s)
+		: m_cur(s.data())
+		, m_end(s.data() + s.size())
+	{ }
+
+	// Returns an empty token at the end of the range
+	Token next(){
+		while(m_cur != m_end && is_space(*m_cur)){ ++m_cur; }
+		const char *first = m_cur;
+		while(m_cur != m_end && !is_space(*m_cur)){ ++m_cur; }
+		return Token{ first, static_cast<size_t>(m_cur - first) };
+	}
+};
+
+// Parses a decimal integer. Returns false if it does not fit in a long.
+// Like std::stol, trailing characters after the digits are ignored.
+inline bool parse_long(const Tokenizer::Token& token, long& value){
+	const char *p = token.data, *last = token.data + token.size;
+	const bool negative = (p != last && *p == '-');
+	if(negative){ ++p; }
+	if(p == last || !std::isdigit(static_cast<unsigned char>(*p))){
+		throw std::invalid_argument("invalid number: " + token.str());
+	}
+	// Accumulate negatively so that LONG_MIN is representable
+	long x = 0;
+	for(; p != last && std::isdigit(static_cast<unsigned char>(*p)); ++p){
+		if(__builtin_mul_overflow(x, 10L, &x) || __builtin_sub_overflow(x, static_cast<long>(*p - '0'), &x)){
+			return false;
+		}
+	}
+	if(!negative){
+		if(x == LONG_MIN){ return false; }
+		x = -x;
+	}
+	value = x;
+	return true;
+}
+
+inline Node parse(Tokenizer& tokens){
+	const auto token = tokens.next();
+	if(token.size == 0){ throw std::runtime_error("empty token"); }
+	Node node;
+	if(token.data[0] == '-' || std::isdigit(static_cast<unsigned char>(token.data[0]))){
+		node.kind = Kind::NUMBER;
+		if(!parse_long(token, node.number)){
+			// Literals beyond the range of long are stored as constant objects
+			node.kind  = Kind::OBJECT;
+			node.cache = make_number(BigInt::from_string(token.str()));
+		}
+	}else if(lookup_builtin(token.data, token.size) == Builtin::AP){
+		node.kind = Kind::APPLY;
+		node.fn   = make_counted<Node>(parse(tokens));
+		node.arg  = make_counted<Node>(parse(tokens));
+	}else{
+		node.kind = Kind::REFERENCE;
+		node.key.assign(token.data, token.size);
+	}
+	return node;
+}
+
+//----------------------------------------------------------------------------
+// Image I/O
+//----------------------------------------------------------------------------
+class ImageWriter {
+private:
+	static const uint8_t *palette(size_t i){
+		static const uint8_t PALETTE[10][3] = {
+			{  31, 119, 180 },
+			{ 255, 127,  14 },
+			{  44, 160,  44 },
+			{ 214,  39,  40 },
+			{ 148, 103, 189 },
+			{ 140,  86,  75 },
+			{ 227, 119, 194 },
+			{ 127, 127, 127 },
+			{ 188, 189,  34 },
+			{  23, 190, 207 }
+		};
+		return PALETTE[i % 10];
+	}
+	std::vector<std::vector<std::pair<int, int>>> m_coords;
+public:
+	void push(std::vector<std::pair<int, int>> coords){
+		m_coords.push_back(std::move(coords));
+	}
+	void reset(){ m_coords.clear(); }
+	void write(const std::string& name) const {
+		if(m_coords.empty()){ return; }
+		int min_x = 0, max_x = 0, min_y = 0, max_y = 0;
+		for(const auto& v : m_coords){
+			for(const auto& p : v){
+				min_x = std::min(min_x, p.first);
+				max_x = std::max(max_x, p.first);
+				min_y = std::min(min_y, p.second);
+				max_y = std::max(max_y, p.second);
+			}
+		}
+		const int width  = max_x - min_x + 1;
+		const int height = max_y - min_y + 1;
+		std::vector<uint8_t> data(width * height * 3, 0);
+		for(size_t i = 0; i < m_coords.size(); ++i){
+			const auto color = palette(i);
+			for(const auto& p : m_coords[i]){
+				const int x = p.first  - min_x;
+				const int y = p.second - min_y;
+				const int k = x * 3 + y * width * 3;
+				data[k + 0] = color[0];
+				data[k + 1] = color[1];
+				data[k + 2] = color[2];
+			}
+		}
+		std::ofstream ofs(name, std::ios::binary);
+		ofs << "P6\n";
+		ofs << width << " " << height << "\n";
+		ofs << "255\n";
+		ofs.write(reinterpret_cast<char*>(data.data()), data.size());
+		ofs.close();
+		std::cerr << "ImageWriter: " << name << " (" << min_x << ", " << min_y << ")" << std::endl;
+	}
+};
+
+//----------------------------------------------------------------------------
+// State history
+//----------------------------------------------------------------------------
+// Keeps (state, result) of every interaction. Objects are immutable, so
+// consecutive versions share all unchanged substructures. The memory cap is
+// in bytes: each entry is charged the growth of live interpreter objects
+// since the previous entry, as counted by Telemetry, which approximates what
+// the new version does not share with older ones.
+class StateHistory {
+public:
+	struct Entry {
+		ObjectPtr state;
+		ObjectPtr result;  // null for the initial state
+		size_t bytes;
+	};
+private:
+	std::deque<Entry> m_entries;
+	size_t m_first_step;  // step number of m_entries.front()
+	size_t m_cursor;      // index of the current entry
+	size_t m_limit;       // bytes
+	size_t m_bytes;       // charged to m_entries
+	size_t m_last_live;   // live bytes when the last entry was added
+public:
+	StateHistory()
+		: m_entries()
+		, m_first_step(0)
+		, m_cursor(0)
+		, m_limit(size_t(256) << 20)
+		, m_bytes(0)
+		, m_last_live(0)
+	{ }
+
+	void set_limit(size_t bytes){
+		m_limit = bytes;
+		shrink();
+	}
+
+	void reset(ObjectPtr state){
+		m_entries.clear();
+		m_entries.push_back(Entry{ std::move(state), nullptr, 0 });
+		m_first_step = 0;
+		m_cursor = 0;
+		m_bytes = 0;
+		m_last_live = Telemetry::instance().snapshot().live_bytes;
+	}
+
+	// Appends a new version and discards versions that were undone
+	void push(ObjectPtr state, ObjectPtr result){
+		for(size_t i = m_cursor + 1; i < m_entries.size(); ++i){ m_bytes -= m_entries[i].bytes; }
+		m_entries.erase(m_entries.begin() + m_cursor + 1, m_entries.end());
+		const size_t live = Telemetry::instance().snapshot().live_bytes;
+		const size_t bytes = (live > m_last_live ? live - m_last_live : 0);
+		m_last_live = live;
+		m_entries.push_back(Entry{ std::move(state), std::move(result), bytes });
+		m_bytes += bytes;
+		m_cursor = m_entries.size() - 1;
+		shrink();
+	}
+
+	bool undo(){
+		if(m_cursor == 0){ return false; }
+		--m_cursor;
+		return true;
+	}
+
+	bool redo(){
+		if(m_cursor + 1 >= m_entries.size()){ return false; }
+		++m_cursor;
+		return true;
+	}
+
+	bool jump(size_t step){
+		if(step < m_first_step || step >= m_first_step + m_entries.size()){ return false; }
+		m_cursor = step - m_first_step;
+		return true;
+	}
+
+	const Entry& current() const { return m_entries[m_cursor]; }
+	size_t step()       const { return m_first_step + m_cursor; }
+	size_t first_step() const { return m_first_step; }
+	size_t last_step()  const { return m_first_step + m_entries.size() - 1; }
+	size_t bytes()      const { return m_bytes; }
+
+private:
+	// Drops the oldest versions over the limit, never the current one
+	void shrink(){
+		while(m_bytes > m_limit && m_cursor > 0){
+			m_bytes -= m_entries.front().bytes;
+			m_entries.pop_front();
+			++m_first_step;
+			--m_cursor;
+		}
+	}
+};
+
+//----------------------------------------------------------------------------
+// Interpreter context
+//----------------------------------------------------------------------------
+struct PrintOptions {
+	size_t max_depth;  // nesting of pairs in the first position (0: unlimited)
+	size_t max_width;  // pairs along a chain of second positions (0: unlimited)
+	bool shared;       // print shared substructures once and refer back to them
+	PrintOptions() : max_depth(0), max_width(0), shared(false) { }
+};
+
+// Owns a program (slots and their dependency graph), the interaction state
+// and its history. Builtins reach the interpreter they run in through
+// Interpreter::current(), which is set by every public member function.
+class Interpreter {
+public:
+	struct Snapshot {
+		ObjectPtr state;
+		size_t step;
+	};
+
+	// Makes an interpreter current on this thread for the lifetime of the scope.
+	// Needed to force values returned by evaluate() outside of member functions.
+	class Scope {
+	private:
+		Interpreter *m_previous;
+	public:
+		explicit Scope(Interpreter& interp)
+			: m_previous(current_pointer())
+		{
+			current_pointer() = &interp;
+		}
+		Scope(const Scope&) = delete;
+		Scope& operator=(const Scope&) = delete;
+		~Scope(){ current_pointer() = m_previous; }
+	};
+
+private:
+	std::map<std::string, NodePtr> m_slots;
+	// Source text of each definition (right hand side) loaded from the program file
+	std::map<std::string, std::string> m_sources;
+	// slot -> slots referenced from its definition
+	std::map<std::string, std::set<std::string>> m_references;
+	// slot -> slots whose definitions reference it
+	std::map<std::string, std::set<std::string>> m_referrers;
+	// Roots given on the command line; empty means every definition is kept.
+	std::vector<std::string> m_roots;
+
+	ImageWriter m_image_writer;
+	StateHistory m_history;
+	PrintOptions m_print_options;
+
+	static Interpreter*& current_pointer(){
+		static thread_local Interpreter *interp = nullptr;
+		return interp;
+	}
+
+	size_t invalidate_dependents(const std::string& key);
+	void unlink_slot(const std::string& key);
+
+public:
+	Interpreter();
+	Interpreter(const Interpreter&) = delete;
+	Interpreter& operator=(const Interpreter&) = delete;
+
+	static Interpreter& current(){
+		if(!current_pointer()){ throw std::runtime_error("no interpreter is active on this thread"); }
+		return *current_pointer();
+	}
+
+	// Program
+	void load_program(const std::string& filename);
+	void reload_program(const std::string& filename, std::ostream& os);
+	void add_root(const std::string& name){ m_roots.push_back(name); }
+	void restrict_to_roots();
+	size_t define_slot(const std::string& key, NodePtr node);
+	size_t remove_slot(const std::string& key);
+	NodePtr find_slot(const std::string& key) const {
+		const auto it = m_slots.find(key);
+		return it == m_slots.end() ? nullptr : it->second;
+	}
+	// find_slot that parses slots pruned by restrict_to_roots back from m_sources
+	NodePtr load_slot(const std::string& key);
+	void write_reachability_report(std::ostream& os) const;
+	void write_compiled_program(const std::string& filename, const std::string& source) const;
+
+	// Evaluation
+	ObjectPtr evaluate(const std::string& expression);
+	// Evaluates an expression; ":key = expression" also defines :key afterwards
+	ObjectPtr execute(const std::string& line);
+	ObjectPtr interact(const galaxy::Vec& click, const std::string& protocol = "galaxy");
+	galaxy::Element to_element(const ObjectPtr& value);
+	void print(std::ostream& os, const ObjectPtr& value);
+
+	// Interaction state
+	ObjectPtr state() const { return find_slot(":state")->cache; }
+	void set_state(ObjectPtr state);
+	Snapshot snapshot() const { return Snapshot{ state(), m_history.step() }; }
+	// Returns false, leaving the state as is, if the history no longer holds the step
+	bool restore(const Snapshot& snapshot);
+	StateHistory& history(){ return m_history; }
+
+	// Output
+	PrintOptions& print_options(){ return m_print_options; }
+	ImageWriter& image_writer(){ return m_image_writer; }
+	void write_image(const std::string& filename);
+};
+
+//----------------------------------------------------------------------------
+// Dependency graph
+//----------------------------------------------------------------------------
+inline void collect_references(const Node& node, std::set<std::string>& refs){
+	if(node.kind == Kind::REFERENCE){
+		if(!is_builtin(node.key)){ refs.insert(node.key); }
+	}else if(node.kind == Kind::APPLY){
+		collect_references(*node.fn,  refs);
+		collect_references(*node.arg, refs);
+	}
+}
+
+// Turns references to `key` into constants holding `value`
+inline void bind_references(Node& node, const std::string& key, const ObjectPtr& value){
+	if(node.kind == Kind::REFERENCE){
+		if(node.key == key){
+			node.kind  = Kind::OBJECT;
+			node.cache = value;
+		}
+	}else if(node.kind == Kind::APPLY){
+		bind_references(*node.fn,  key, value);
+		bind_references(*node.arg, key, value);
+	}
+}
+
+inline void clear_cache(Node& node){
+	if(node.kind == Kind::OBJECT){ return; }
+	if(node.cache){ Telemetry::instance().thunk_released(); }
+	node.cache.reset();
+	if(node.kind == Kind::APPLY){
+		clear_cache(*node.fn);
+		clear_cache(*node.arg);
+	}
+}
+
+// Drops memoized values of all slots depending on `key` transitively.
+// Returns the number of invalidated slots.
+// The node of `key` itself is left alone: when it was just defined from the
+// old value of `key`, its references still hold that value, and clearing them
+// would make the slot refer to itself.
+inline size_t Interpreter::invalidate_dependents(const std::string& key){
+	std::set<std::string> visited = { key };
+	std::queue<std::string> q;
+	const auto first = m_referrers.find(key);
+	if(first != m_referrers.end()){
+		for(const auto& next : first->second){
+			if(visited.insert(next).second){ q.push(next); }
+		}
+	}
+	while(!q.empty()){
+		const auto cur = q.front();
+		q.pop();
+		const auto it = m_referrers.find(cur);
+		if(it == m_referrers.end()){ continue; }
+		for(const auto& next : it->second){
+			if(visited.insert(next).second){ q.push(next); }
+		}
+	}
+	visited.erase(key);
+	for(const auto& k : visited){
+		const auto it = m_slots.find(k);
+		if(it != m_slots.end() && it->second){ clear_cache(*it->second); }
+	}
+	return visited.size();
+}
+
+inline void Interpreter::unlink_slot(const std::string& key){
+	const auto it = m_references.find(key);
+	if(it == m_references.end()){ return; }
+	for(const auto& r : it->second){ m_referrers[r].erase(key); }
+	m_references.erase(it);
+}
+
+// Replaces the definition of `key` and invalidates its dependents.
+inline size_t Interpreter::define_slot(const std::string& key, NodePtr node){
+	unlink_slot(key);
+	auto& refs = m_references[key];
+	collect_references(*node, refs);
+	refs.erase(key);  // self-references are not dependencies to invalidate
+	for(const auto& r : refs){ m_referrers[r].insert(key); }
+	const bool redefined = (m_slots.count(key) != 0);
+	m_slots[key] = std::move(node);
+	return redefined ? invalidate_dependents(key) : 0;
+}
+
+inline size_t Interpreter::remove_slot(const std::string& key){
+	unlink_slot(key);
+	const auto invalidated = invalidate_dependents(key);
+	m_slots.erase(key);
+	m_sources.erase(key);
+	return invalidated;
+}
+
+// Splits "key = body" in [first, last). `body` points to the character after '='.
+inline bool split_definition(const char *first, const char *last, std::string& key, const char *& body){
+	const char *eq = std::find(first, last, '=');
+	if(eq == last){ return false; }
+	const auto token = Tokenizer(first, eq).next();
+	if(token.size == 0){ return false; }
+	key.assign(token.data, token.size);
+	body = eq + 1;
+	return true;
+}
+
+inline bool split_definition(const std::string& line, std::string& key, std::string& body){
+	const char *first = nullptr;
+	if(!split_definition(line.data(), line.data() + line.size(), key, first)){ return false; }
+	body.assign(first, line.data() + line.size());
+	return true;
+}
+
+//----------------------------------------------------------------------------
+// Program loader
+//----------------------------------------------------------------------------
+// Read-only memory mapping of a whole file
+class MappedFile {
+private:
+	const char *m_data;
+	size_t m_size;
+public:
+	explicit MappedFile(const std::string& filename)
+		: m_data(nullptr)
+		, m_size(0)
+	{
+		const int fd = open(filename.c_str(), O_RDONLY);
+		if(fd < 0){ throw std::runtime_error("failed to open " + filename); }
+		struct stat st;
+		if(fstat(fd, &st) != 0){
+			close(fd);
+			throw std::runtime_error("failed to stat " + filename);
+		}
+		m_size = static_cast<size_t>(st.st_size);
+		if(m_size > 0){
+			void *p = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+			if(p == MAP_FAILED){
+				close(fd);
+				throw std::runtime_error("failed to map " + filename);
+			}
+			m_data = static_cast<const char*>(p);
+		}
+		close(fd);
+	}
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+	~MappedFile(){
+		if(m_data){ munmap(const_cast<char*>(m_data), m_size); }
+	}
+	const char *begin() const { return m_data; }
+	const char *end() const { return m_data + m_size; }
+	size_t size() const { return m_size; }
+};
+
+struct Definition {
+	std::string key;
+	std::string body;
+	NodePtr node;  // null if only the source was read
+};
+
+// Parses the definitions in [first, last). Both ends must lie on line boundaries.
+// Without `parse_nodes` only keys and bodies are split off.
+inline void parse_definitions(const char *first, const char *last, std::vector<Definition>& out, bool parse_nodes){
+	std::string key;
+	while(first < last){
+		const char *eol = std::find(first, last, '\n');
+		const char *body = nullptr;
+		const bool found = split_definition(first, eol, key, body);
+		first = (eol == last) ? last : eol + 1;
+		if(!found){ continue; }
+		NodePtr node;
+		if(parse_nodes){
+			Tokenizer tokens(body, eol);
+			node = make_counted<Node>(parse(tokens));
+		}
+		out.push_back(Definition{ key, std::string(body, eol), std::move(node) });
+	}
+}
+
+// Parses chunks of the file on worker threads, then links the definitions
+// into m_slots in file order so that later definitions still win. With roots
+// only the sources are kept; restrict_to_roots parses what they reach.
+inline void Interpreter::load_program(const std::string& filename){
+	static const size_t MIN_CHUNK_SIZE = 1 << 16;
+	const MappedFile file(filename);
+	const size_t num_threads = std::max(1u, std::thread::hardware_concurrency());
+	const size_t num_chunks = std::max<size_t>(1, std::min(num_threads, file.size() / MIN_CHUNK_SIZE));
+
+	std::vector<const char*> bounds(1, file.begin());
+	for(size_t i = 1; i < num_chunks; ++i){
+		const char *p = std::max(file.begin() + file.size() / num_chunks * i, bounds.back());
+		p = std::find(p, file.end(), '\n');
+		bounds.push_back(p == file.end() ? p : p + 1);
+	}
+	bounds.push_back(file.end());
+
+	std::vector<std::vector<Definition>> chunks(num_chunks);
+	std::vector<std::exception_ptr> errors(num_chunks);
+	const bool parse_nodes = m_roots.empty();
+	auto worker = [&](size_t i){
+		try {
+			parse_definitions(bounds[i], bounds[i + 1], chunks[i], parse_nodes);
+		}catch(...){
+			errors[i] = std::current_exception();
+		}
+	};
+	std::vector<std::thread> threads;
+	for(size_t i = 1; i < num_chunks; ++i){ threads.emplace_back(worker, i); }
+	worker(0);
+	for(auto& t : threads){ t.join(); }
+	for(const auto& e : errors){
+		if(e){ std::rethrow_exception(e); }
+	}
+
+	for(auto& chunk : chunks){
+		for(auto& def : chunk){
+			if(def.node){ define_slot(def.key, std::move(def.node)); }
+			m_sources[def.key] = std::move(def.body);
+		}
+	}
+}
+
+//----------------------------------------------------------------------------
+// Reachability analysis
+//----------------------------------------------------------------------------
+inline size_t count_nodes(const Node& node){
+	if(node.kind != Kind::APPLY){ return 1; }
+	return 1 + count_nodes(*node.fn) + count_nodes(*node.arg);
+}
+
+// Keeps only slots reachable from m_roots, parsing the ones load_program
+// left as source. Definitions needed later (e.g. after a reload, or by a
+// command) are parsed from m_sources on demand.
+// Throws if a root is not defined by the program.
+inline void Interpreter::restrict_to_roots(){
+	if(m_roots.empty()){ return; }
+	for(const auto& r : m_roots){
+		if(m_slots.count(r) == 0 && m_sources.count(r) == 0){ throw std::runtime_error("unknown root: " + r); }
+	}
+	std::set<std::string> reachable(m_roots.begin(), m_roots.end());
+	std::queue<std::string> q;
+	for(const auto& r : m_roots){ q.push(r); }
+	while(!q.empty()){
+		const auto cur = q.front();
+		q.pop();
+		if(m_slots.count(cur) == 0){
+			const auto it = m_sources.find(cur);
+			if(it == m_sources.end()){ continue; }
+			Tokenizer tokens(it->second);
+			define_slot(cur, make_counted<Node>(parse(tokens)));
+		}
+		for(const auto& next : m_references[cur]){
+			if(reachable.insert(next).second){ q.push(next); }
+		}
+	}
+	std::vector<std::string> unreachable;
+	for(const auto& kv : m_slots){
+		if(kv.first[0] == ':' && m_sources.count(kv.first) == 0){ continue; }
+		if(reachable.count(kv.first) == 0){ unreachable.push_back(kv.first); }
+	}
+	for(const auto& k : unreachable){
+		unlink_slot(k);
+		m_slots.erase(k);
+	}
+}
+
+inline NodePtr Interpreter::load_slot(const std::string& key){
+	auto slot = find_slot(key);
+	if(slot){ return slot; }
+	const auto it = m_sources.find(key);
+	if(it == m_sources.end()){ return nullptr; }
+	Tokenizer tokens(it->second);
+	slot = make_counted<Node>(parse(tokens));
+	define_slot(key, slot);
+	return slot;
+}
+
+inline void Interpreter::write_reachability_report(std::ostream& os) const {
+	size_t total_nodes = 0;
+	for(const auto& kv : m_slots){
+		if(kv.second){ total_nodes += count_nodes(*kv.second); }
+	}
+	os << "Slots: " << m_slots.size() << " / " << m_sources.size() << " definitions, "
+	   << total_nodes << " nodes" << std::endl;
+	os << "slot\tnodes\tfan-in\tfan-out" << std::endl;
+	for(const auto& kv : m_slots){
+		if(!kv.second){ continue; }
+		const auto in  = m_referrers.find(kv.first);
+		const auto out = m_references.find(kv.first);
+		os << kv.first << "\t" << count_nodes(*kv.second)
+		   << "\t" << (in  == m_referrers.end()  ? 0 : in->second.size())
+		   << "\t" << (out == m_references.end() ? 0 : out->second.size()) << std::endl;
+	}
+}
+
+// Re-parses only definitions whose text has changed since the last load.
+inline void Interpreter::reload_program(const std::string& filename, std::ostream& os){
+	std::ifstream ifs(filename);
+	if(!ifs){ throw std::runtime_error("failed to open " + filename); }
+	std::map<std::string, std::string> sources;
+	std::string line, key, body;
+	while(std::getline(ifs, line)){
+		if(split_definition(line, key, body)){ sources[key] = body; }
+	}
+	size_t changed = 0, removed = 0, invalidated = 0;
+	for(const auto& kv : sources){
+		const auto it = m_sources.find(kv.first);
+		if(it != m_sources.end() && it->second == kv.second){ continue; }
+		if(!m_roots.empty() && m_slots.count(kv.first) == 0){
+			// Not reachable so far; parsed by restrict_to_roots or load_slot if needed
+			m_sources[kv.first] = kv.second;
+			++changed;
+			continue;
+		}
+		Tokenizer tokens(kv.second);
+		invalidated += define_slot(kv.first, make_counted<Node>(parse(tokens)));
+		m_sources[kv.first] = kv.second;
+		++changed;
+	}
+	std::vector<std::string> stale;
+	for(const auto& kv : m_sources){
+		if(sources.count(kv.first) == 0){ stale.push_back(kv.first); }
+	}
+	for(const auto& k : stale){
+		invalidated += remove_slot(k);
+		++removed;
+	}
+	restrict_to_roots();
+	os << "reload: " << changed << " changed, " << removed << " removed, "
+	          << invalidated << " invalidated" << std::endl;
+}
+
+//----------------------------------------------------------------------------
+// Function declarations
+//----------------------------------------------------------------------------
+struct Object {
+	virtual bool is_nil()       const { return false; }
+	virtual bool is_number()    const { return false; }
+	virtual bool is_modulated() const { return false; }
+	virtual bool is_bignum()    const { return false; }
+	virtual bool is_pair()      const { return false; }
+
+	virtual long number() const { throw std::runtime_error("object is not a number"); }
+	virtual BigInt bignum() const { return BigInt(number()); }
+	virtual std::string modulated() const { throw std::runtime_error("object is not a modulated"); }
+	virtual ObjectPtr first()  const { throw std::runtime_error("object is not a pair"); }
+	virtual ObjectPtr second() const { throw std::runtime_error("object is not a pair"); }
+
+	virtual ObjectPtr call(NodePtr arg) = 0;
+
+	// Calls with an already evaluated argument.
+	// Strict objects override this to consume the value without boxing it into a node.
+	virtual ObjectPtr call_value(ObjectPtr arg);
+
+	// Returns true if call() always forces its argument.
+	// Arguments of strict objects can be evaluated eagerly and passed by call_value().
+	virtual bool is_strict() { return false; }
+
+	virtual void dump(std::ostream&) const { throw std::runtime_error("dump() is not implemented"); }
+};
+
+ObjectPtr evaluate(NodePtr node);
+
+inline ObjectPtr force(const NodePtr& node){ return evaluate(node); }
+inline ObjectPtr force(const ObjectPtr& obj){ return obj; }
+
+// Impl must provide:
+//   template <typename T0, typename T1> static ObjectPtr call(const T0&, const T1&);
+//   static const bool STRICT;  // whether call() always forces the 2nd argument
+template <typename Impl>
+struct ObjectHelper2 : public Object{
+private:
+	class T1 : public Object {
+	private:
+		NodePtr m_arg0;
+	public:
+		T1(NodePtr arg0) : m_arg0(std::move(arg0)) { }
+		virtual ObjectPtr call(NodePtr arg1){
+			return Impl::call(m_arg0, arg1);
+		}
+		virtual ObjectPtr call_value(ObjectPtr arg1){
+			return Impl::call(m_arg0, arg1);
+		}
+		virtual bool is_strict(){ return Impl::STRICT; }
+	};
+public:
+	virtual ObjectPtr call(NodePtr arg){
+		return make_counted<T1>(arg);
+	}
+};
+
+// Impl must provide:
+//   static ObjectPtr call(NodePtr, NodePtr, NodePtr);
+//   static bool is_strict(NodePtr, NodePtr);  // whether call() always forces the 3rd argument
+template <typename Impl>
+struct ObjectHelper3 : public Object{
+private:
+	class T2 : public Object {
+	private:
+		enum class Strictness { UNKNOWN, ANALYZING, STRICT, LAZY };
+		NodePtr m_arg0, m_arg1;
+		Strictness m_strictness;
+	public:
+		T2(NodePtr arg0, NodePtr arg1)
+			: m_arg0(std::move(arg0)), m_arg1(std::move(arg1)), m_strictness(Strictness::UNKNOWN) { }
+		virtual ObjectPtr call(NodePtr arg2){
+			return Impl::call(m_arg0, m_arg1, arg2);
+		}
+		virtual bool is_strict(){
+			// Recursive definitions are conservatively treated as lazy
+			if(m_strictness == Strictness::UNKNOWN){
+				m_strictness = Strictness::ANALYZING;
+				m_strictness = Impl::is_strict(m_arg0, m_arg1) ? Strictness::STRICT : Strictness::LAZY;
+			}
+			return m_strictness == Strictness::STRICT;
+		}
+	};
+	class T1 : public Object {
+	private:
+		NodePtr m_arg0;
+	public:
+		T1(NodePtr arg0) : m_arg0(std::move(arg0)) { }
+		virtual ObjectPtr call(NodePtr arg1){
+			return make_counted<T2>(m_arg0, arg1);
+		}
+	};
+public:
+	virtual ObjectPtr call(NodePtr arg){
+		return make_counted<T1>(arg);
+	}
+};
+
+inline NodePtr as_node(ObjectPtr obj){
+	auto node = make_counted<Node>();
+	node->kind  = Kind::OBJECT;
+	node->cache = obj;
+	return node;
+}
+
+inline ObjectPtr Object::call_value(ObjectPtr arg){
+	return call(as_node(std::move(arg)));
+}
+
+inline ObjectPtr apply(ObjectPtr fn, ObjectPtr arg){
+	return fn->call_value(std::move(arg));
+}
+
+// Applies fn to the lazy application (x1 x2), evaluating it eagerly if fn is strict
+inline ObjectPtr apply_composed(ObjectPtr fn, NodePtr x1, NodePtr x2){
+	if(fn->is_strict()){
+		return fn->call_value(evaluate(x1)->call(x2));
+	}
+	auto tmp = make_counted<Node>();
+	tmp->kind = Kind::APPLY;
+	tmp->fn   = std::move(x1);
+	tmp->arg  = std::move(x2);
+	return fn->call(tmp);
+}
+
+// #1, 2, 3 - Numbers
+struct Number : public Object {
+private:
+	long m_value;
+public:
+	explicit Number(long x) : m_value(x) { }
+	virtual bool is_number() const override { return true; }
+	virtual long number()    const override { return m_value; }
+	virtual ObjectPtr call(NodePtr) override { throw std::runtime_error("number is not a callable"); }
+	virtual void dump(std::ostream& os) const override { os << m_value; }
+};
+
+// Numbers out of the range of long
+struct BigNumber : public Object {
+private:
+	BigInt m_value;
+public:
+	explicit BigNumber(BigInt x) : m_value(std::move(x)) { }
+	virtual bool is_number() const override { return true; }
+	virtual bool is_bignum() const override { return true; }
+	virtual long number()    const override { throw std::runtime_error("number is out of range"); }
+	virtual BigInt bignum()  const override { return m_value; }
+	virtual ObjectPtr call(NodePtr) override { throw std::runtime_error("number is not a callable"); }
+	virtual void dump(std::ostream& os) const override { os << m_value.to_string(); }
+};
+
+// Objects are immutable, so small numbers are allocated once and shared
+const long SHARED_NUMBER_MIN = -128;
+const long SHARED_NUMBER_MAX = 1023;
+
+inline const ObjectPtr *shared_numbers(){
+	static const std::vector<ObjectPtr> numbers = []{
+		std::vector<ObjectPtr> v;
+		for(long x = SHARED_NUMBER_MIN; x <= SHARED_NUMBER_MAX; ++x){ v.push_back(make_counted<Number>(x)); }
+		return v;
+	}();
+	return numbers.data() - SHARED_NUMBER_MIN;
+}
+
+inline ObjectPtr make_number(long x){
+	if(SHARED_NUMBER_MIN <= x && x <= SHARED_NUMBER_MAX){ return shared_numbers()[x]; }
+	return make_counted<Number>(x);
+}
+
+inline ObjectPtr make_number(BigInt x){
+	if(x.fits_long()){ return make_number(x.to_long()); }
+	return make_counted<BigNumber>(std::move(x));
+}
+
+// #5 - Successor
+struct Inc : public Object {
+	virtual ObjectPtr call(NodePtr arg) override {
+		return call_value(evaluate(arg));
+	}
+	virtual ObjectPtr call_value(ObjectPtr arg) override {
+		long r;
+		if(!arg->is_bignum() && !__builtin_add_overflow(arg->number(), 1l, &r)){
+			return make_number(r);
+		}
+		return make_number(arg->bignum() + BigInt(1));
+	}
+	virtual bool is_strict() override { return true; }
+};
+
+// #6 - Predecessor
+struct Dec : public Object {
+	virtual ObjectPtr call(NodePtr arg) override {
+		return call_value(evaluate(arg));
+	}
+	virtual ObjectPtr call_value(ObjectPtr arg) override {
+		long r;
+		if(!arg->is_bignum() && !__builtin_sub_overflow(arg->number(), 1l, &r)){
+			return make_number(r);
+		}
+		return make_number(arg->bignum() - BigInt(1));
+	}
+	virtual bool is_strict() override { return true; }
+};
+
+// #7 - Sum
+struct SumImpl {
+	static const bool STRICT = true;
+	template <typename T0, typename T1>
+	static ObjectPtr call(const T0& x0, const T1& x1){
+		const auto a = force(x0), b = force(x1);
+		long r;
+		if(!a->is_bignum() && !b->is_bignum() && !__builtin_add_overflow(a->number(), b->number(), &r)){
+			return make_number(r);
+		}
+		return make_number(a->bignum() + b->bignum());
+	}
+};
+using Sum = ObjectHelper2<SumImpl>;
+
+// #9 - Product
+struct ProdImpl {
+	static const bool STRICT = true;
+	template <typename T0, typename T1>
+	static ObjectPtr call(const T0& x0, const T1& x1){
+		const auto a = force(x0), b = force(x1);
+		long r;
+		if(!a->is_bignum() && !b->is_bignum() && !__builtin_mul_overflow(a->number(), b->number(), &r)){
+			return make_number(r);
+		}
+		return make_number(a->bignum() * b->bignum());
+	}
+};
+using Prod = ObjectHelper2<ProdImpl>;
+
+// #10 - Integer Division
+struct DivImpl {
+	static const bool STRICT = true;
+	template <typename T0, typename T1>
+	static ObjectPtr call(const T0& x0, const T1& x1){
+		const auto a = force(x0), b = force(x1);
+		if(!a->is_bignum() && !b->is_bignum()){
+			const long x = a->number(), y = b->number();
+			if(y == 0){ throw std::runtime_error("division by zero"); }
+			if(x != LONG_MIN || y != -1){ return make_number(x / y); }
+		}
+		return make_number(a->bignum() / b->bignum());
+	}
+};
+using Div = ObjectHelper2<DivImpl>;
+
+// #21 - True (K Combinator)
+struct TrueImpl {
+	static const bool STRICT = false;
+	template <typename T0, typename T1>
+	static ObjectPtr call(const T0& x0, const T1&){
+		return force(x0);
+	}
+};
+using True = ObjectHelper2<TrueImpl>;
+
+// #22 - False
+struct FalseImpl {
+	static const bool STRICT = true;
+	template <typename T0, typename T1>
+	static ObjectPtr call(const T0&, const T1& x1){
+		return force(x1);
+	}
+};
+using False = ObjectHelper2<FalseImpl>;
+
+// #11 - Equality and Booleans
+struct EqImpl {
+	static const bool STRICT = true;
+	static bool test(const ObjectPtr& a, const ObjectPtr& b){
+		if(!a->is_bignum() && !b->is_bignum()){
+			return a->number() == b->number();
+		}else{
+			return a->bignum() == b->bignum();
+		}
+	}
+	template <typename T0, typename T1>
+	static ObjectPtr call(const T0& x0, const T1& x1){
+		if(test(force(x0), force(x1))){
+			return make_counted<True>();
+		}else{
+			return make_counted<False>();
+		}
+	}
+};
+using Eq = ObjectHelper2<EqImpl>;
+
+// #12 - Strict Less Than
+struct LtImpl {
+	static const bool STRICT = true;
+	static bool test(const ObjectPtr& a, const ObjectPtr& b){
+		if(!a->is_bignum() && !b->is_bignum()){
+			return a->number() < b->number();
+		}else{
+			return a->bignum() < b->bignum();
+		}
+	}
+	template <typename T0, typename T1>
+	static ObjectPtr call(const T0& x0, const T1& x1){
+		if(test(force(x0), force(x1))){
+			return make_counted<True>();
+		}else{
+			return make_counted<False>();
+		}
+	}
+};
+using Lt = ObjectHelper2<LtImpl>;
+
+// #16 - Negate
+struct Negate : public Object {
+	virtual ObjectPtr call(NodePtr x0) override {
+		return call_value(evaluate(x0));
+	}
+	virtual ObjectPtr call_value(ObjectPtr x0) override {
+		if(!x0->is_bignum() && x0->number() != LONG_MIN){
+			return make_number(-x0->number());
+		}
+		return make_number(-x0->bignum());
+	}
+	virtual bool is_strict() override { return true; }
+};
+
+// #18 - S Combinator
+struct SImpl {
+	static ObjectPtr call(NodePtr x0, NodePtr x1, NodePtr x2){
+		return apply_composed(evaluate(x0)->call(x2), x1, x2);
+	}
+	static bool is_strict(NodePtr x0, NodePtr){
+		return evaluate(x0)->is_strict();
+	}
+};
+using S = ObjectHelper3<SImpl>;
+
+// #19 - C Combinator
+struct CImpl {
+	static ObjectPtr call(NodePtr x0, NodePtr x1, NodePtr x2){
+		return evaluate(x0)->call(x2)->call(x1);
+	}
+	static bool is_strict(NodePtr x0, NodePtr){
+		return evaluate(x0)->is_strict();
+	}
+};
+using C = ObjectHelper3<CImpl>;
+
+// #20 - B Combinator
+struct BImpl {
+	static ObjectPtr call(NodePtr x0, NodePtr x1, NodePtr x2){
+		return apply_composed(evaluate(x0), x1, x2);
+	}
+	static bool is_strict(NodePtr x0, NodePtr x1){
+		return evaluate(x0)->is_strict() && evaluate(x1)->is_strict();
+	}
+};
+using B = ObjectHelper3<BImpl>;
+
+// #24 - I Combinator
+struct I : public Object {
+	virtual ObjectPtr call(NodePtr x0) override {
+		return evaluate(x0);
+	}
+	virtual ObjectPtr call_value(ObjectPtr x0) override {
+		return x0;
+	}
+	virtual bool is_strict() override { return true; }
+};
+
+// #25 - Cons
+class Cons : public Object {
+private:
+	class Cons2 : public Object {
+	private:
+		NodePtr m_arg0, m_arg1;
+	public:
+		Cons2(NodePtr arg0, NodePtr arg1) : m_arg0(arg0), m_arg1(arg1) { }
+		virtual ObjectPtr call(NodePtr arg2) override {
+			return evaluate(arg2)->call(m_arg0)->call(m_arg1);
+		}
+		virtual ObjectPtr call_value(ObjectPtr arg2) override {
+			return arg2->call(m_arg0)->call(m_arg1);
+		}
+		virtual bool is_strict() override { return true; }
+		virtual bool is_pair() const override { return true; }
+		virtual ObjectPtr first()  const override { return evaluate(m_arg0); }
+		virtual ObjectPtr second() const override { return evaluate(m_arg1); }
+	};
+	class Cons1 : public Object {
+	private:
+		NodePtr m_arg0;
+	public:
+		explicit Cons1(NodePtr arg0) : m_arg0(arg0) { }
+		virtual ObjectPtr call(NodePtr arg1) override {
+			return make_counted<Cons2>(m_arg0, arg1);
+		}
+	};
+public:
+	virtual ObjectPtr call(NodePtr arg){
+		return make_counted<Cons1>(arg);
+	}
+};
+
+// #26 - Car (First)
+struct Car : public Object {
+	virtual ObjectPtr call(NodePtr x0) override {
+		return call_value(evaluate(x0));
+	}
+	virtual ObjectPtr call_value(ObjectPtr x0) override {
+		static const NodePtr t = as_node(make_counted<True>());
+		return x0->call(t);
+	}
+	virtual bool is_strict() override { return true; }
+};
+
+// #27 - Cdr (Tail)
+struct Cdr : public Object {
+	virtual ObjectPtr call(NodePtr x0) override {
+		return call_value(evaluate(x0));
+	}
+	virtual ObjectPtr call_value(ObjectPtr x0) override {
+		static const NodePtr f = as_node(make_counted<False>());
+		return x0->call(f);
+	}
+	virtual bool is_strict() override { return true; }
+};
+
+// #28 - Nil
+class Nil : public Object {
+public:
+	virtual bool is_nil() const override { return true; }
+	virtual ObjectPtr call(NodePtr) override {
+		return make_counted<True>();
+	}
+	virtual ObjectPtr call_value(ObjectPtr) override {
+		return make_counted<True>();
+	}
+	virtual void dump(std::ostream& os) const override { os << "nil"; }
+};
+
+// #29 - Is Nil
+class IsNil : public Object {
+public:
+	virtual ObjectPtr call(NodePtr arg) override {
+		return call_value(evaluate(arg));
+	}
+	virtual ObjectPtr call_value(ObjectPtr arg) override {
+		if(arg->is_nil()){
+			return make_counted<True>();
+		}else{
+			return make_counted<False>();
+		}
+	}
+	virtual bool is_strict() override { return true; }
+};
+
+// #37 - Is Zero
+class IsZero : public Object {
+public:
+	virtual ObjectPtr call(NodePtr arg) override {
+		return call_value(evaluate(arg));
+	}
+	static bool test(const ObjectPtr& t){
+		return t->is_number() && !t->is_bignum() && t->number() == 0;
+	}
+	virtual ObjectPtr call_value(ObjectPtr t) override {
+		if(test(t)){
+			return make_counted<True>();
+		}else{
+			return make_counted<False>();
+		}
+	}
+	virtual bool is_strict() override { return true; }
+};
+
+// #13 - Modulate
+struct Modulated : public Object {
+private:
+	std::string m_signal;
+public:
+	explicit Modulated(std::string signal) : m_signal(std::move(signal)) { }
+	virtual bool is_modulated() const override { return true; }
+	virtual std::string modulated() const override { return m_signal; }
+	virtual ObjectPtr call(NodePtr) override { throw std::runtime_error("modulated is not a callable"); }
+	virtual void dump(std::ostream& os) const override { os << "[" << m_signal << "]"; }
+};
+
+struct Modulate : public Object {
+private:
+	static void impl(std::ostream& os, ObjectPtr cur){
+		if(cur->is_number() && !cur->is_bignum() && cur->number() != LONG_MIN){
+			const long x = cur->number();
+			if(x == 0){
+				os << "010";
+			}else{
+				const long y = std::abs(x);
+				os << (x >= 0 ? "01" : "10");
+				const int bits = (sizeof(long) * 8 - __builtin_clzl(y) + 3) & ~3;
+				for(int i = 0; i < bits; i += 4){ os << "1"; }
+				os << "0";
+				for(int i = bits - 1; i >= 0; --i){ os << ((y >> i) & 1); }
+			}
+		}else if(cur->is_number()){
+			const BigInt x = cur->bignum();
+			os << (x.is_negative() ? "10" : "01");
+			const size_t bits = (x.bit_length() + 3) & ~size_t(3);
+			for(size_t i = 0; i < bits; i += 4){ os << "1"; }
+			os << "0";
+			for(size_t i = bits; i > 0; --i){ os << (x.bit(i - 1) ? '1' : '0'); }
+		}else if(cur->is_nil()){
+			os << "00";
+		}else{
+			os << "11";
+			impl(os, apply(make_counted<Car>(), cur));
+			impl(os, apply(make_counted<Cdr>(), cur));
+		}
+	}
+public:
+	virtual ObjectPtr call(NodePtr arg) override {
+		std::ostringstream oss;
+		impl(oss, evaluate(arg));
+		return make_counted<Modulated>(oss.str());
+	}
+};
+
+// #14 - Demodulate
+struct Demodulate : public Object {
+private:
+	static ObjectPtr impl(std::istream& is){
+		const char m0 = is.get();
+		const char m1 = is.get();
+		if(m0 != m1){
+			const long sign = (m0 == '0' ? 1 : -1);
+			int bits = 0;
+			while(is.get() == '1'){ bits += 4; }
+			if(bits < static_cast<int>(sizeof(long) * 8)){
+				long value = 0;
+				for(int i = 0; i < bits; ++i){
+					value = (value << 1) | (is.get() - '0');
+				}
+				return make_counted<Number>(sign * value);
+			}
+			BigInt value;
+			for(int i = bits - 1; i >= 0; --i){
+				if(is.get() == '1'){ value.set_bit(i); }
+			}
+			return make_number(sign < 0 ? -value : value);
+		}else if(m0 == '0'){
+			return make_counted<Nil>();
+		}else if(m0 == '1'){
+			auto first = impl(is);
+			auto tail  = impl(is);
+			return apply(apply(make_counted<Cons>(), first), tail);
+		}
+		return nullptr;
+	}
+public:
+	virtual ObjectPtr call(NodePtr arg) override {
+		auto value = evaluate(arg);
+		if(!value->is_modulated()){ throw std::runtime_error("value is not modulated"); }
+		std::istringstream iss(value->modulated());
+		return impl(iss);
+	}
+};
+
+// #15 - Send
+struct Send : public Object {
+private:
+	static size_t callback(char *buffer, size_t size, size_t nmemb, void *userdata){
+		std::vector<char> *v = reinterpret_cast<std::vector<char>*>(userdata);
+		v->reserve(v->size() + size * nmemb + 1);
+		for(size_t i = 0; i < size * nmemb; ++i){ v->push_back(buffer[i]); }
+		return size * nmemb;
+	}
+public:
+	virtual ObjectPtr call(NodePtr arg) override {
+		const auto signal = apply(make_counted<Modulate>(), evaluate(arg));
+		const auto modulated = signal->modulated();
+		std::cerr << "Send: " << modulated << std::endl;
+		const char *url = "https://icfpc2020-api.testkontur.ru/aliens/send?apiKey=b0a3d915b8d742a39897ab4dab931721";
+		CURL *curl = curl_easy_init();
+		std::vector<char> received_raw;
+		curl_easy_setopt(curl, CURLOPT_URL, url);
+		curl_easy_setopt(curl, CURLOPT_POSTFIELDS, modulated.c_str());
+		curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, callback);
+		curl_easy_setopt(curl, CURLOPT_WRITEDATA, &received_raw);
+		curl_easy_perform(curl);
+		curl_easy_cleanup(curl);
+		received_raw.push_back('\0');
+		const std::string received(received_raw.data());
+		std::cerr << "Recv: " << received << std::endl;
+		return apply(make_counted<Demodulate>(), make_counted<Modulated>(received));
+	}
+};
+
+// #31 - Vector
+using Vector = Cons;
+
+// #32 - Draw
+struct Picture : public Object {
+private:
+	std::vector<std::pair<int, int>> m_coords;
+public:
+	explicit Picture(std::vector<std::pair<int, int>> coords) : m_coords(std::move(coords)) { }
+	virtual ObjectPtr call(NodePtr) override { throw std::runtime_error("picture is not a callable"); }
+	virtual void dump(std::ostream& os) const override {
+#ifdef PICTURE_DETAILED
+		bool is_first = true;
+		os << "|";
+		for(const auto& p : m_coords){
+			if(!is_first){ os << ", "; }
+			is_first = false;
+			os << "(" << p.first << ", " << p.second << ")";
+		}
+		os << "|";
+#else
+		os << "|picture|";
+#endif
+		Interpreter::current().image_writer().push(m_coords);
+	}
+};
+
+struct Draw : public Object {
+	virtual ObjectPtr call(NodePtr arg) override {
+		std::vector<std::pair<int, int>> coords;
+		auto cur = evaluate(arg);
+		while(!cur->is_nil()){
+			auto p = apply(make_counted<Car>(), cur);
+			const int x = apply(make_counted<Car>(), p)->number();
+			const int y = apply(make_counted<Cdr>(), p)->number();
+			coords.emplace_back(x, y);
+			cur = apply(make_counted<Cdr>(), cur);
+		}
+		return make_counted<Picture>(std::move(coords));
+	}
+};
+
+// #34 - Multiple Draw
+struct MultipleDraw : public Object {
+	virtual ObjectPtr call(NodePtr arg) override {
+		auto cur = evaluate(arg);
+		if(cur->is_nil()){ return make_counted<Nil>(); }
+		auto first = apply(make_counted<Car>(), cur);
+		auto tail  = apply(make_counted<Cdr>(), cur);
+		return make_counted<Cons>()
+			->call(as_node(apply(make_counted<Draw>(), first)))
+			->call(as_node(apply(make_counted<MultipleDraw>(), tail)));
+	}
+};
+
+// #38 - Interact
+struct InteractImpl {
+	static ObjectPtr call(NodePtr protocol, NodePtr state, NodePtr vector){
+		Telemetry::instance().interact_step();
+		auto t = evaluate(protocol)->call(state)->call(vector);
+		auto flag = apply(make_counted<Car>(), t);
+		if(flag->number() == 0){
+			auto ret = apply(make_counted<Cdr>(), t);
+			auto state = apply(make_counted<Car>(), ret);
+			auto data  = apply(make_counted<Car>(), apply(make_counted<Cdr>(), ret));
+			auto& interp = Interpreter::current();
+			interp.set_state(state);
+			auto result = make_counted<Cons>()
+				->call(as_node(state))
+				->call(as_node(apply(make_counted<MultipleDraw>(), data)));
+			interp.history().push(state, result);
+			return result;
+		}else{
+			auto ret   = apply(make_counted<Cdr>(), t);
+			auto state = apply(make_counted<Car>(), ret);
+			auto data  = apply(make_counted<Car>(), apply(make_counted<Cdr>(), ret));
+			auto recv  = apply(make_counted<Send>(), data);
+			auto interact = make_counted<ObjectHelper3<InteractImpl>>();
+			return interact->call(protocol)->call(as_node(state))->call(as_node(recv));
+		}
+	}
+	static bool is_strict(NodePtr, NodePtr){
+		return false;
+	}
+};
+using Interact = ObjectHelper3<InteractImpl>;
+
+
+inline std::shared_ptr<Object> evaluate(NodePtr node){
+	auto factory = [&]() -> ObjectPtr {
+		if(node->kind == Kind::NUMBER){
+			return make_number(node->number);
+		}else if(node->kind == Kind::REFERENCE){
+			const auto& k = node->key;
+			switch(lookup_builtin(k)){
+			case Builtin::INC:      return make_counted<Inc>();
+			case Builtin::DEC:      return make_counted<Dec>();
+			case Builtin::ADD:      return make_counted<Sum>();
+			case Builtin::MUL:      return make_counted<Prod>();
+			case Builtin::DIV:      return make_counted<Div>();
+			case Builtin::EQ:       return make_counted<Eq>();
+			case Builtin::LT:       return make_counted<Lt>();
+			case Builtin::MOD:      return make_counted<Modulate>();
+			case Builtin::DEM:      return make_counted<Demodulate>();
+			case Builtin::SEND:     return make_counted<Send>();
+			case Builtin::NEG:      return make_counted<Negate>();
+			case Builtin::S:        return make_counted<S>();
+			case Builtin::C:        return make_counted<C>();
+			case Builtin::B:        return make_counted<B>();
+			case Builtin::T:        return make_counted<True>();
+			case Builtin::F:        return make_counted<False>();
+			// TODO pwr2
+			case Builtin::I:        return make_counted<I>();
+			case Builtin::CONS:     return make_counted<Cons>();
+			case Builtin::CAR:      return make_counted<Car>();
+			case Builtin::CDR:      return make_counted<Cdr>();
+			case Builtin::NIL:      return make_counted<Nil>();
+			case Builtin::ISNIL:    return make_counted<IsNil>();
+			case Builtin::IF0:      return make_counted<IsZero>();
+			case Builtin::INTERACT: return make_counted<Interact>();
+			default: break;
+			}
+			const auto slot = Interpreter::current().load_slot(k);
+			if(!slot){ throw std::runtime_error("undefined slot: " + k); }
+			auto t = evaluate(slot);
+			return t;
+		}else if(node->kind == Kind::APPLY){
+			auto t = evaluate(node->fn)->call(node->arg);
+			return t;
+		}
+		return nullptr;
+	};
+	if(node->cache){ return node->cache; }
+	auto value = factory();
+	if(!node->cache && value){ Telemetry::instance().thunk_cached(); }
+	node->cache = std::move(value);
+	return node->cache;
+}
+
+
+//----------------------------------------------------------------------------
+// Printer
+//----------------------------------------------------------------------------
+// Prints evaluation results without recursion.
+// Output is buffered and handed to the stream in chunks.
+// Pairs that close a cycle (and, with PrintOptions::shared, pairs that are
+// referenced more than once) are labelled as #n= and referred to as #n#.
+class Printer {
+private:
+	static const size_t CHUNK_SIZE = 1 << 16;
+
+	struct Label {
+		size_t references;
+		bool cyclic;
+		bool on_path;
+		size_t id;
+		Label() : references(0), cyclic(false), on_path(false), id(0) { }
+	};
+
+	struct Frame {
+		ObjectPtr object;
+		const char *text;
+		size_t depth, width;
+		bool leave;
+		Frame(ObjectPtr o, size_t d, size_t w, bool l = false)
+			: object(std::move(o)), text(nullptr), depth(d), width(w), leave(l) { }
+		explicit Frame(const char *t)
+			: object(), text(t), depth(0), width(0), leave(false) { }
+	};
+
+	std::ostream& m_os;
+	PrintOptions m_options;
+	std::ostringstream m_buffer;
+	std::unordered_map<const Object*, Label> m_labels;
+	size_t m_next_id;
+
+	bool truncated(size_t depth, size_t width) const {
+		return (m_options.max_depth > 0 && depth >= m_options.max_depth)
+		    || (m_options.max_width > 0 && width >= m_options.max_width);
+	}
+
+	bool needs_label(const Label& label) const {
+		return label.cyclic || (m_options.shared && label.references > 1);
+	}
+
+	void flush_if_full(){
+		if(static_cast<size_t>(m_buffer.tellp()) < CHUNK_SIZE){ return; }
+		m_os << m_buffer.str();
+		m_os.flush();
+		m_buffer.str("");
+	}
+
+	// Depth-first search over the printed part of the structure to find
+	// pairs that are shared or lie on a cycle.
+	void scan(const ObjectPtr& root){
+		std::vector<Frame> stack(1, Frame(root, 0, 0));
+		while(!stack.empty()){
+			Frame frame = std::move(stack.back());
+			stack.pop_back();
+			Label& label = m_labels[frame.object.get()];
+			if(frame.leave){
+				label.on_path = false;
+				continue;
+			}
+			++label.references;
+			if(label.references > 1){
+				if(label.on_path){ label.cyclic = true; }
+				continue;
+			}
+			label.on_path = true;
+			stack.emplace_back(frame.object, 0, 0, true);
+			if(!truncated(frame.depth, frame.width + 1)){
+				auto tail = frame.object->second();
+				if(tail->is_pair()){ stack.emplace_back(tail, frame.depth, frame.width + 1); }
+			}
+			if(!truncated(frame.depth + 1, 0)){
+				auto head = frame.object->first();
+				if(head->is_pair()){ stack.emplace_back(head, frame.depth + 1, 0); }
+			}
+		}
+	}
+
+public:
+	Printer(std::ostream& os, const PrintOptions& options)
+		: m_os(os)
+		, m_options(options)
+		, m_buffer()
+		, m_labels()
+		, m_next_id(0)
+	{ }
+
+	void print(const ObjectPtr& root){
+		if(root->is_pair()){ scan(root); }
+		std::vector<Frame> stack(1, Frame(root, 0, 0));
+		while(!stack.empty()){
+			flush_if_full();
+			Frame frame = std::move(stack.back());
+			stack.pop_back();
+			if(frame.text){
+				m_buffer << frame.text;
+				continue;
+			}
+			if(!frame.object->is_pair()){
+				frame.object->dump(m_buffer);
+				continue;
+			}
+			if(truncated(frame.depth, frame.width)){
+				m_buffer << "...";
+				continue;
+			}
+			const auto it = m_labels.find(frame.object.get());
+			Label *label = (it == m_labels.end()) ? nullptr : &it->second;
+			if(frame.leave){
+				if(label){ label->on_path = false; }
+				continue;
+			}
+			if(label && needs_label(*label)){
+				if(label->id > 0 && (label->on_path || m_options.shared)){
+					m_buffer << "#" << label->id << "#";
+					continue;
+				}
+				if(label->id == 0){ label->id = ++m_next_id; }
+				m_buffer << "#" << label->id << "=";
+			}
+			if(label){ label->on_path = true; }
+			stack.emplace_back(frame.object, frame.depth, frame.width, true);
+			stack.emplace_back(")");
+			stack.emplace_back(frame.object->second(), frame.depth, frame.width + 1);
+			stack.emplace_back(", ");
+			stack.emplace_back(frame.object->first(), frame.depth + 1, 0);
+			m_buffer << "(";
+		}
+		m_os << m_buffer.str();
+		m_buffer.str("");
+	}
+};
+
+inline void print_object(std::ostream& os, const ObjectPtr& obj){
+	Printer(os, Interpreter::current().print_options()).print(obj);
+}
+
+//----------------------------------------------------------------------------
+// Conversion from/to galaxy::Element
+//----------------------------------------------------------------------------
+// Converts evaluated values into libgalaxy elements, forcing them on demand.
+// Elements are plain values, so shared substructures are copied; forcing
+// them again is cheap because evaluated nodes keep their cache.
+class ElementConverter {
+private:
+	std::set<const Object*> m_active;
+
+	static bool is_scalar(const ObjectPtr& obj){
+		return obj->is_number() && !obj->is_bignum();
+	}
+
+	galaxy::Element convert_pair(const ObjectPtr& obj){
+		if(!m_active.insert(obj.get()).second){
+			throw std::runtime_error("cyclic value cannot be converted to an element");
+		}
+		auto head = obj->first();
+		auto tail = obj->second();
+		galaxy::Element result;
+		if(is_scalar(head) && is_scalar(tail)){
+			result = galaxy::Element(galaxy::Vec(head->number(), tail->number()));
+		}else{
+			std::vector<galaxy::Element> list;
+			std::vector<const Object*> cells(1, obj.get());
+			list.push_back(convert(head));
+			while(tail->is_pair()){
+				if(!m_active.insert(tail.get()).second){
+					throw std::runtime_error("cyclic value cannot be converted to an element");
+				}
+				cells.push_back(tail.get());
+				list.push_back(convert(tail->first()));
+				tail = tail->second();
+			}
+			if(!tail->is_nil()){ throw std::runtime_error("improper list cannot be converted to an element"); }
+			for(const auto c : cells){ m_active.erase(c); }
+			result = galaxy::Element(std::move(list));
+		}
+		m_active.erase(obj.get());
+		return result;
+	}
+
+public:
+	galaxy::Element convert(const ObjectPtr& obj){
+		if(obj->is_nil()){ return galaxy::Element(); }
+		if(is_scalar(obj)){ return galaxy::Element(obj->number()); }
+		if(obj->is_pair()){ return convert_pair(obj); }
+		if(obj->is_number()){ throw std::runtime_error("number is out of range of an element"); }
+		throw std::runtime_error("value cannot be converted to an element");
+	}
+};
+
+inline galaxy::Element to_element(const ObjectPtr& obj){
+	return ElementConverter().convert(obj);
+}
+
+// Node holding an evaluated argument; nil and small numbers share theirs
+inline NodePtr value_node(ObjectPtr value){
+	static const std::vector<NodePtr> numbers = []{
+		std::vector<NodePtr> v;
+		for(long x = SHARED_NUMBER_MIN; x <= SHARED_NUMBER_MAX; ++x){ v.push_back(as_node(make_number(x))); }
+		return v;
+	}();
+	static const NodePtr nil = as_node(make_counted<Nil>());
+	if(value->is_nil()){ return nil; }
+	if(value->is_number() && !value->is_bignum()){
+		const long x = value->number();
+		if(SHARED_NUMBER_MIN <= x && x <= SHARED_NUMBER_MAX){ return numbers[x - SHARED_NUMBER_MIN]; }
+	}
+	return as_node(std::move(value));
+}
+
+inline ObjectPtr make_pair_object(ObjectPtr a, ObjectPtr b){
+	static const ObjectPtr cons = make_counted<Cons>();
+	return cons->call(value_node(std::move(a)))->call(value_node(std::move(b)));
+}
+
+// Builds interpreter values from an element. The result is fully evaluated.
+inline ObjectPtr from_element(const galaxy::Element& e){
+	static const ObjectPtr nil = make_counted<Nil>();
+	if(e.is_number()){
+		return make_number(e.as_number());
+	}else if(e.is_vector()){
+		const auto& v = e.as_vector();
+		return make_pair_object(make_number(v.x), make_number(v.y));
+	}else if(e.is_list()){
+		const auto& list = e.as_list();
+		ObjectPtr result = nil;
+		for(auto it = list.rbegin(); it != list.rend(); ++it){
+			result = make_pair_object(from_element(*it), std::move(result));
+		}
+		return result;
+	}
+	return nil;
+}
+
+//----------------------------------------------------------------------------
+// Ahead-of-time translation
+//----------------------------------------------------------------------------
+// Runtime support for the code generated by CppTranslator
+const size_t COMPILED_MAX_ARITY = 8;
+using CompiledFunction = ObjectPtr (*)(const NodePtr*);
+
+class CompiledClosure : public Object {
+private:
+	CompiledFunction m_function;
+	size_t m_arity;
+	size_t m_count;
+	std::array<NodePtr, COMPILED_MAX_ARITY> m_args;
+public:
+	CompiledClosure(CompiledFunction function, size_t arity)
+		: m_function(function), m_arity(arity), m_count(0), m_args() { }
+	virtual ObjectPtr call(NodePtr arg) override {
+		if(m_count + 1 == m_arity){
+			std::array<NodePtr, COMPILED_MAX_ARITY> args(m_args);
+			args[m_count] = std::move(arg);
+			return m_function(args.data());
+		}
+		auto next = make_counted<CompiledClosure>(*this);
+		next->m_args[next->m_count++] = std::move(arg);
+		return next;
+	}
+};
+
+inline NodePtr make_apply(NodePtr fn, NodePtr arg){
+	auto node = make_counted<Node>();
+	node->kind = Kind::APPLY;
+	node->fn   = std::move(fn);
+	node->arg  = std::move(arg);
+	return node;
+}
+
+inline NodePtr make_number_node(long x){
+	auto node = make_counted<Node>();
+	node->kind   = Kind::NUMBER;
+	node->number = x;
+	return node;
+}
+
+inline NodePtr parse_node(const char *source){
+	Tokenizer tokens(source, source + std::strlen(source));
+	return make_counted<Node>(parse(tokens));
+}
+
+inline NodePtr make_reference_node(const char *key){
+	auto node = make_counted<Node>();
+	node->kind = Kind::REFERENCE;
+	node->key  = key;
+	return node;
+}
+
+// Translates slot definitions into C++ functions over the runtime above.
+// Each definition is reduced symbolically (S/B/C/I/t/f/cons at the head of
+// the spine, eta-expanding partial applications) into a supercombinator:
+// a function of N arguments whose body only contains applications of
+// variables, slots and strict builtins. Closed subterms become shared
+// constant nodes, so memoization matches the interpreter. Conditional arms
+// and strict operands are reduced too, turning saturated slot applications
+// into direct calls; parameters a definition always evaluates are evaluated
+// once on entry and by its callers instead of being passed as thunks.
+class CppTranslator {
+
+private:
+	struct Term;
+	using TermPtr = std::shared_ptr<const Term>;
+	struct Term {
+		enum class Type { VARIABLE, NUMBER, CONSTANT, BUILTIN, SLOT, APPLY };
+		Type type;
+		long number;
+		std::string name;
+		TermPtr fn, arg;
+	};
+
+	struct Definition {
+		std::string key;
+		TermPtr body;
+		size_t arity;
+	};
+
+	static const size_t REDUCTION_LIMIT = 4096;
+	static const size_t INLINE_LIMIT    = 16;  // inlined calls per definition
+	static const size_t INLINE_SIZE     = 64;  // max size of inlined bodies
+
+	std::vector<TermPtr> m_terms;  // keeps every term alive while translating
+	std::vector<Definition> m_definitions;
+	std::map<std::string, size_t> m_slot_index;
+	std::vector<uint32_t> m_strict;  // parameters each definition always evaluates
+
+	std::map<const Term*, bool> m_closed;
+	std::map<const Term*, std::string> m_constants;
+	std::map<std::string, std::string> m_builtin_constants;
+	std::vector<std::string> m_constant_inits;
+
+	// Per-function state
+	uint32_t m_evaluated;  // parameters evaluated on entry
+	std::map<const Term*, int> m_uses;
+	std::map<const Term*, std::string> m_locals;
+	size_t m_local_counter;
+
+	TermPtr make_term(typename Term::Type type, long number, std::string name, TermPtr fn, TermPtr arg){
+		auto t = std::make_shared<Term>();
+		t->type   = type;
+		t->number = number;
+		t->name   = std::move(name);
+		t->fn     = std::move(fn);
+		t->arg    = std::move(arg);
+		m_terms.push_back(t);
+		return t;
+	}
+	TermPtr make_variable(size_t i){ return make_term(Term::Type::VARIABLE, i, "", nullptr, nullptr); }
+	TermPtr make_app(TermPtr f, TermPtr a){ return make_term(Term::Type::APPLY, 0, "", f, a); }
+	TermPtr make_app(TermPtr f, TermPtr a, TermPtr b){ return make_app(make_app(f, a), b); }
+
+	TermPtr from_node(const Node& node){
+		if(node.kind == Kind::NUMBER){
+			return make_term(Term::Type::NUMBER, node.number, "", nullptr, nullptr);
+		}else if(node.kind == Kind::REFERENCE){
+			const auto type = is_builtin(node.key) ? Term::Type::BUILTIN : Term::Type::SLOT;
+			return make_term(type, 0, node.key, nullptr, nullptr);
+		}else if(node.kind == Kind::APPLY){
+			return make_app(from_node(*node.fn), from_node(*node.arg));
+		}else if(node.cache && node.cache->is_bignum()){
+			return make_term(Term::Type::CONSTANT, 0, node.cache->bignum().to_string(), nullptr, nullptr);
+		}
+		throw std::runtime_error("cannot translate an evaluated object");
+	}
+
+	static TermPtr unwind(TermPtr t, std::vector<TermPtr>& args){
+		args.clear();
+		while(t->type == Term::Type::APPLY){
+			args.push_back(t->arg);
+			t = t->fn;
+		}
+		std::reverse(args.begin(), args.end());
+		return t;
+	}
+
+	static size_t expansion_arity(const std::string& name){
+		if(name == "i" || name == "inc" || name == "dec" || name == "neg"){ return 1; }
+		if(name == "car" || name == "cdr" || name == "isnil" || name == "if0"){ return 1; }
+		if(name == "t" || name == "f" || name == "cons"){ return 2; }
+		if(name == "add" || name == "mul" || name == "div" || name == "eq" || name == "lt"){ return 2; }
+		if(name == "s" || name == "b" || name == "c"){ return 3; }
+		return 0;
+	}
+
+	size_t term_size(const TermPtr& t, size_t limit){
+		if(t->type != Term::Type::APPLY){ return 1; }
+		const size_t l = term_size(t->fn, limit);
+		if(l >= limit){ return l; }
+		return 1 + l + term_size(t->arg, limit - l);
+	}
+
+	TermPtr substitute(const TermPtr& t, const std::vector<TermPtr>& args, std::map<const Term*, TermPtr>& memo){
+		if(t->type == Term::Type::VARIABLE){ return args[t->number]; }
+		if(t->type != Term::Type::APPLY){ return t; }
+		const auto it = memo.find(t.get());
+		if(it != memo.end()){ return it->second; }
+		const auto r = make_app(substitute(t->fn, args, memo), substitute(t->arg, args, memo));
+		memo[t.get()] = r;
+		return r;
+	}
+
+	// Reduces the head of `body`. With `arity` given, partial applications
+	// are eta-expanded into new variables; with `reduced` given, calls to
+	// small definitions in it are inlined as well.
+	bool reduce_head(TermPtr& body, size_t *arity, const std::vector<Definition> *reduced){
+		size_t inline_budget = INLINE_LIMIT;
+		std::vector<TermPtr> args;
+		for(size_t step = 0; step < REDUCTION_LIMIT; ++step){
+			const TermPtr head = unwind(body, args);
+			const size_t n = args.size();
+			if(head->type == Term::Type::SLOT && reduced && m_slot_index.count(head->name)){
+				const auto& target = (*reduced)[m_slot_index.at(head->name)];
+				if(target.arity == 0){ break; }
+				if(n < target.arity){
+					if(!arity || *arity >= COMPILED_MAX_ARITY){ break; }
+					body = make_app(body, make_variable((*arity)++));
+					continue;
+				}
+				if(inline_budget == 0 || term_size(target.body, INLINE_SIZE) >= INLINE_SIZE){ break; }
+				--inline_budget;
+				std::map<const Term*, TermPtr> memo;
+				TermPtr next = substitute(target.body, args, memo);
+				for(size_t i = target.arity; i < n; ++i){ next = make_app(next, args[i]); }
+				body = next;
+				continue;
+			}
+			if(head->type != Term::Type::BUILTIN){ break; }
+			const auto& h = head->name;
+			TermPtr next;
+			size_t used = 0;
+			if(h == "i" && n >= 1){
+				next = args[0]; used = 1;
+			}else if(h == "t" && n >= 2){
+				next = args[0]; used = 2;
+			}else if(h == "f" && n >= 2){
+				next = args[1]; used = 2;
+			}else if(h == "s" && n >= 3){
+				next = make_app(args[0], args[2], make_app(args[1], args[2])); used = 3;
+			}else if(h == "b" && n >= 3){
+				next = make_app(args[0], make_app(args[1], args[2])); used = 3;
+			}else if(h == "c" && n >= 3){
+				next = make_app(args[0], args[2], args[1]); used = 3;
+			}else if(h == "cons" && n >= 3){
+				next = make_app(args[2], args[0], args[1]); used = 3;
+			}else if(n < expansion_arity(h) && arity && *arity < COMPILED_MAX_ARITY){
+				body = make_app(body, make_variable((*arity)++));
+				continue;
+			}else{
+				break;
+			}
+			for(size_t i = used; i < n; ++i){ next = make_app(next, args[i]); }
+			body = next;
+			if(term_size(body, 65536) >= 65536){ return false; }
+		}
+		return true;
+	}
+
+	bool reduce(Definition& def, const std::vector<Definition> *reduced){
+		return reduce_head(def.body, &def.arity, reduced);
+	}
+
+	static size_t condition_arity(const std::string& h){
+		if(h == "eq" || h == "lt"){ return 4; }
+		if(h == "isnil" || h == "if0"){ return 3; }
+		return 0;
+	}
+
+	// Arguments of a saturated call to a compiled definition, 0 otherwise
+	size_t call_arity(const TermPtr& head, size_t n) const {
+		if(head->type != Term::Type::SLOT){ return 0; }
+		const auto it = m_slot_index.find(head->name);
+		if(it == m_slot_index.end()){ return 0; }
+		const size_t arity = m_definitions[it->second].arity;
+		return (arity > 0 && n >= arity) ? arity : 0;
+	}
+
+	// Reduces every subterm that value() and emit_return() evaluate
+	// immediately: operands of strict builtins, conditions and both arms of
+	// conditionals, and arguments of direct calls, which may be evaluated
+	// before the call. Saturated slot applications exposed this way become
+	// direct calls. Shared subterms stay shared.
+	TermPtr normalize(const TermPtr& t, std::map<const Term*, TermPtr>& memo){
+		if(t->type != Term::Type::APPLY || is_closed(t)){ return t; }
+		const auto it = memo.find(t.get());
+		if(it != memo.end()){ return it->second; }
+		TermPtr body = t;
+		if(!reduce_head(body, nullptr, nullptr)){ body = t; }
+		std::vector<TermPtr> args;
+		const TermPtr head = unwind(body, args);
+		size_t strict = 0;
+		if(head->type == Term::Type::BUILTIN){
+			const auto& h = head->name;
+			if(args.size() == condition_arity(h)){
+				strict = args.size();
+			}else if(h == "add" || h == "mul" || h == "div" || h == "eq" || h == "lt"){
+				strict = 2;
+			}else if(expansion_arity(h) == 1){
+				strict = 1;
+			}
+		}else{
+			strict = call_arity(head, args.size());
+		}
+		bool changed = (body != t);
+		for(size_t i = 0; i < std::min(strict, args.size()); ++i){
+			const auto a = normalize(args[i], memo);
+			changed |= (a != args[i]);
+			args[i] = a;
+		}
+		TermPtr result = t;
+		if(changed){
+			result = head;
+			for(const auto& a : args){ result = make_app(result, a); }
+		}
+		memo[t.get()] = result;
+		return result;
+	}
+
+	// Variables that evaluating `t` always evaluates, as a bit mask
+	uint32_t strict_variables(const TermPtr& t, std::map<const Term*, uint32_t>& memo){
+		if(t->type == Term::Type::VARIABLE){ return 1u << t->number; }
+		if(t->type != Term::Type::APPLY || is_closed(t)){ return 0; }
+		const auto it = memo.find(t.get());
+		if(it != memo.end()){ return it->second; }
+		std::vector<TermPtr> args;
+		const TermPtr head = unwind(t, args);
+		const size_t n = args.size();
+		uint32_t result = 0;
+		if(head->type == Term::Type::VARIABLE){
+			result = 1u << head->number;
+		}else if(head->type == Term::Type::BUILTIN){
+			const auto& h = head->name;
+			const size_t k = condition_arity(h);
+			if(k > 0 && n == k){
+				for(size_t i = 0; i + 2 < n; ++i){ result |= strict_variables(args[i], memo); }
+				result |= strict_variables(args[n - 2], memo) & strict_variables(args[n - 1], memo);
+			}else if(n >= 2 && (h == "add" || h == "mul" || h == "div" || h == "eq" || h == "lt")){
+				result = strict_variables(args[0], memo) | strict_variables(args[1], memo);
+			}else if(n >= 1 && expansion_arity(h) == 1){
+				result = strict_variables(args[0], memo);
+			}
+		}else if(const size_t arity = call_arity(head, n)){
+			const uint32_t strict = m_strict[m_slot_index.at(head->name)];
+			for(size_t i = 0; i < arity; ++i){
+				if(strict & (1u << i)){ result |= strict_variables(args[i], memo); }
+			}
+		}
+		memo[t.get()] = result;
+		return result;
+	}
+
+	// Parameters every definition always evaluates. Starts from all of them
+	// and removes the ones a body does not evaluate until nothing changes,
+	// so recursive calls count as evaluating what they are strict in.
+	void analyze_strictness(const std::vector<TermPtr>& bodies){
+		m_strict.assign(m_definitions.size(), 0);
+		for(size_t i = 0; i < m_definitions.size(); ++i){
+			m_strict[i] = static_cast<uint32_t>((1ull << m_definitions[i].arity) - 1);
+		}
+		for(bool changed = true; changed; ){
+			changed = false;
+			for(size_t i = 0; i < m_definitions.size(); ++i){
+				if(m_definitions[i].arity == 0){ continue; }
+				std::map<const Term*, uint32_t> memo;
+				const uint32_t strict = m_strict[i] & strict_variables(bodies[i], memo);
+				if(strict != m_strict[i]){
+					m_strict[i] = strict;
+					changed = true;
+				}
+			}
+		}
+	}
+
+	bool is_closed(const TermPtr& t){
+		const auto it = m_closed.find(t.get());
+		if(it != m_closed.end()){ return it->second; }
+		bool result = true;
+		if(t->type == Term::Type::VARIABLE){
+			result = false;
+		}else if(t->type == Term::Type::APPLY){
+			result = is_closed(t->fn) & is_closed(t->arg);
+		}
+		m_closed[t.get()] = result;
+		return result;
+	}
+
+	std::string slot_node(const std::string& key){
+		return "slots[" + std::to_string(m_slot_index.at(key)) + "]";
+	}
+
+	std::string escape(const std::string& s){
+		std::string r;
+		for(const char c : s){
+			if(c == '"' || c == '\\'){ r.push_back('\\'); }
+			r.push_back(c);
+		}
+		return r;
+	}
+
+	static void write_source(std::ostream& os, const TermPtr& t){
+		if(t->type == Term::Type::APPLY){
+			os << "ap ";
+			write_source(os, t->fn);
+			os << " ";
+			write_source(os, t->arg);
+		}else if(t->type == Term::Type::NUMBER){
+			os << t->number;
+		}else{
+			os << t->name;
+		}
+	}
+
+	// Expression of type NodePtr evaluating a closed term once
+	std::string constant(const TermPtr& t){
+		if(t->type == Term::Type::SLOT && m_slot_index.count(t->name)){ return slot_node(t->name); }
+		if(t->type == Term::Type::BUILTIN){
+			const auto it = m_builtin_constants.find(t->name);
+			if(it != m_builtin_constants.end()){ return it->second; }
+		}
+		const auto it = m_constants.find(t.get());
+		if(it != m_constants.end()){ return it->second; }
+		std::string init;
+		if(t->type == Term::Type::NUMBER){
+			init = "make_number_node(" + std::to_string(t->number) + "l)";
+		}else if(t->type == Term::Type::CONSTANT){
+			init = "as_node(make_number(BigInt::from_string(\"" + t->name + "\")))";
+		}else if(t->type == Term::Type::APPLY){
+			// Closed terms are evaluated at most once, so they are cheaper to
+			// parse at startup than to compile
+			std::ostringstream oss;
+			write_source(oss, t);
+			init = "parse_node(\"" + escape(oss.str()) + "\")";
+		}else{
+			init = "make_reference_node(\"" + escape(t->name) + "\")";
+		}
+		const auto name = "constants[" + std::to_string(m_constant_inits.size()) + "]";
+		m_constant_inits.push_back(init);
+		if(t->type == Term::Type::BUILTIN){
+			m_builtin_constants[t->name] = name;
+		}else{
+			m_constants[t.get()] = name;
+		}
+		return name;
+	}
+
+	void count_uses(const TermPtr& t){
+		if(++m_uses[t.get()] > 1){ return; }
+		if(t->type == Term::Type::APPLY && !is_closed(t)){
+			count_uses(t->fn);
+			count_uses(t->arg);
+		}
+	}
+
+	std::string new_local(){
+		return "t" + std::to_string(m_local_counter++);
+	}
+
+	// Expression of type NodePtr for a lazily evaluated term
+	std::string thunk(std::ostream& os, const std::string& indent, const TermPtr& t){
+		if(t->type == Term::Type::VARIABLE){ return "x[" + std::to_string(t->number) + "]"; }
+		if(is_closed(t)){ return constant(t); }
+		if(t->fn->type == Term::Type::BUILTIN && t->fn->name == "i"){ return thunk(os, indent, t->arg); }
+		const auto it = m_locals.find(t.get());
+		if(it != m_locals.end()){ return it->second; }
+		const auto f = thunk(os, indent, t->fn);
+		const auto a = thunk(os, indent, t->arg);
+		const auto name = new_local();
+		os << indent << "const NodePtr " << name << " = make_apply(" << f << ", " << a << ");" << std::endl;
+		m_locals[t.get()] = name;
+		return name;
+	}
+
+	std::string apply_rest(
+		std::ostream& os, const std::string& indent, std::string expr,
+		const std::vector<TermPtr>& args, size_t first)
+	{
+		for(size_t i = first; i < args.size(); ++i){
+			expr += "->call(" + thunk(os, indent, args[i]) + ")";
+		}
+		return expr;
+	}
+
+	// Expression of type ObjectPtr evaluating a term immediately
+	std::string value(std::ostream& os, const std::string& indent, const TermPtr& t){
+		if(t->type == Term::Type::VARIABLE && (m_evaluated & (1u << t->number))){
+			return "v" + std::to_string(t->number);
+		}
+		if(t->type == Term::Type::VARIABLE || is_closed(t) || m_uses[t.get()] > 1){
+			return "evaluate(" + thunk(os, indent, t) + ")";
+		}
+		std::vector<TermPtr> args;
+		const TermPtr head = unwind(t, args);
+		const size_t n = args.size();
+		if(head->type == Term::Type::BUILTIN){
+			const auto& h = head->name;
+			if(n >= 1 && h == "i"){
+				return apply_rest(os, indent, value(os, indent, args[0]), args, 1);
+			}
+			if(n >= 2 && (h == "add" || h == "mul" || h == "div" || h == "eq" || h == "lt")){
+				static const std::map<std::string, std::string> impls = {
+					{ "add", "SumImpl" }, { "mul", "ProdImpl" }, { "div", "DivImpl" },
+					{ "eq", "EqImpl" }, { "lt", "LtImpl" }
+				};
+				const auto a = value(os, indent, args[0]);
+				const auto b = value(os, indent, args[1]);
+				return apply_rest(os, indent, impls.at(h) + "::call(" + a + ", " + b + ")", args, 2);
+			}
+			if(n >= 1 && expansion_arity(h) == 1 && h != "i"){
+				const auto a = value(os, indent, args[0]);
+				return apply_rest(os, indent, "g_builtin_" + h + ".call_value(" + a + ")", args, 1);
+			}
+		}else if(head->type == Term::Type::SLOT && m_slot_index.count(head->name)){
+			const auto& def = m_definitions[m_slot_index.at(head->name)];
+			if(def.arity > 0 && n >= def.arity){
+				// Arguments the callee always evaluates are evaluated here,
+				// skipping their thunks
+				const uint32_t strict = m_strict[m_slot_index.at(head->name)];
+				std::vector<std::string> params;
+				for(size_t i = 0; i < def.arity; ++i){
+					const auto& a = args[i];
+					if((strict & (1u << i)) && a->type == Term::Type::APPLY && !is_closed(a) && m_uses[a.get()] <= 1){
+						const auto v = value(os, indent, a);
+						params.push_back(new_local());
+						os << indent << "const NodePtr " << params.back() << " = value_node(" << v << ");" << std::endl;
+					}else{
+						params.push_back(thunk(os, indent, a));
+					}
+				}
+				const auto name = new_local();
+				os << indent << "const NodePtr " << name << "[] = { ";
+				for(size_t i = 0; i < params.size(); ++i){ os << (i ? ", " : "") << params[i]; }
+				os << " };" << std::endl;
+				const auto call = "f" + std::to_string(m_slot_index.at(head->name)) + "(" + name + ")";
+				return apply_rest(os, indent, call, args, def.arity);
+			}
+		}
+		const auto fn = (head->type == Term::Type::VARIABLE || is_closed(head))
+			? "evaluate(" + thunk(os, indent, head) + ")"
+			: value(os, indent, head);
+		return apply_rest(os, indent, fn, args, 0);
+	}
+
+	// Statements returning the value of a term, inlining conditionals
+	void emit_return(std::ostream& os, const std::string& indent, const TermPtr& t){
+		std::vector<TermPtr> args;
+		const TermPtr head = unwind(t, args);
+		const size_t n = args.size();
+		std::string cond;
+		size_t first = 0;
+		if(m_uses[t.get()] <= 1 && !is_closed(t) && head->type == Term::Type::BUILTIN){
+			const auto& h = head->name;
+			if((h == "eq" || h == "lt") && n == 4){
+				const auto a = value(os, indent, args[0]);
+				const auto b = value(os, indent, args[1]);
+				cond  = (h == "eq" ? "EqImpl::test(" : "LtImpl::test(") + a + ", " + b + ")";
+				first = 2;
+			}else if(h == "isnil" && n == 3){
+				cond  = value(os, indent, args[0]) + "->is_nil()";
+				first = 1;
+			}else if(h == "if0" && n == 3){
+				cond  = "IsZero::test(" + value(os, indent, args[0]) + ")";
+				first = 1;
+			}
+		}
+		if(cond.empty()){
+			const auto v = value(os, indent, t);
+			os << indent << "return " << v << ";" << std::endl;
+			return;
+		}
+		const auto saved_locals = m_locals;
+		os << indent << "if(" << cond << "){" << std::endl;
+		emit_return(os, indent + "\t", args[first]);
+		m_locals = saved_locals;
+		os << indent << "}else{" << std::endl;
+		emit_return(os, indent + "\t", args[first + 1]);
+		m_locals = saved_locals;
+		os << indent << "}" << std::endl;
+	}
+
+public:
+	CppTranslator()
+		: m_terms()
+		, m_definitions()
+		, m_slot_index()
+		, m_strict()
+		, m_closed()
+		, m_constants()
+		, m_builtin_constants()
+		, m_constant_inits()
+		, m_evaluated(0)
+		, m_uses()
+		, m_locals()
+		, m_local_counter(0)
+	{ }
+
+	void add(const std::string& key, const Node& node){
+		Definition def;
+		def.key   = key;
+		def.body  = from_node(node);
+		def.arity = 0;
+		m_slot_index[key] = m_definitions.size();
+		m_definitions.push_back(std::move(def));
+	}
+
+	void write(std::ostream& os, const std::string& source){
+		for(auto& def : m_definitions){
+			const auto original = def.body;
+			if(!reduce(def, nullptr)){
+				def.body  = original;
+				def.arity = 0;
+			}
+		}
+		const auto reduced = m_definitions;
+		for(auto& def : m_definitions){
+			const auto original = def;
+			if(!reduce(def, &reduced)){ def = original; }
+		}
+		std::ostringstream functions;
+		std::vector<TermPtr> normalized(m_definitions.size());
+		for(size_t i = 0; i < m_definitions.size(); ++i){
+			if(m_definitions[i].arity == 0){ continue; }
+			std::map<const Term*, TermPtr> memo;
+			normalized[i] = normalize(m_definitions[i].body, memo);
+		}
+		analyze_strictness(normalized);
+		for(size_t i = 0; i < m_definitions.size(); ++i){
+			const auto& def = m_definitions[i];
+			if(def.arity == 0){ continue; }
+			m_uses.clear();
+			m_locals.clear();
+			m_local_counter = 0;
+			const auto& body = normalized[i];
+			count_uses(body);
+			functions << "// " << def.key << " (arity " << def.arity << ")" << std::endl;
+			// Bodies that ignore their arguments leave the parameter unnamed
+			functions << "ObjectPtr f" << i << "(const NodePtr *" << (is_closed(body) ? "" : "x") << "){" << std::endl;
+			m_evaluated = m_strict[i];
+			for(size_t j = 0; j < def.arity; ++j){
+				if(m_evaluated & (1u << j)){
+					functions << "\tconst ObjectPtr v" << j << " = evaluate(x[" << j << "]);" << std::endl;
+				}
+			}
+			emit_return(functions, "\t", body);
+			functions << "}" << std::endl << std::endl;
+		}
+		std::vector<std::string> bodies(m_definitions.size());
+		for(size_t i = 0; i < m_definitions.size(); ++i){
+			const auto& def = m_definitions[i];
+			if(def.arity == 0){ bodies[i] = constant(def.body); }
+		}
+
+		os << "// Generated from " << source << " by the galaxy interpreter (--emit-cpp)." << std::endl;
+		os << "// Do not edit." << std::endl;
+		os << "#define GALAXY_AOT" << std::endl;
+		os << "#include \"main.cpp\"" << std::endl << std::endl;
+		os << "namespace compiled {" << std::endl << std::endl;
+		os << "Inc    g_builtin_inc;"   << std::endl;
+		os << "Dec    g_builtin_dec;"   << std::endl;
+		os << "Negate g_builtin_neg;"   << std::endl;
+		os << "Car    g_builtin_car;"   << std::endl;
+		os << "Cdr    g_builtin_cdr;"   << std::endl;
+		os << "IsNil  g_builtin_isnil;" << std::endl;
+		os << "IsZero g_builtin_if0;"   << std::endl << std::endl;
+		os << "NodePtr slots[" << std::max<size_t>(m_definitions.size(), 1) << "];" << std::endl;
+		os << "NodePtr constants[" << std::max<size_t>(m_constant_inits.size(), 1) << "];" << std::endl << std::endl;
+		for(size_t i = 0; i < m_definitions.size(); ++i){
+			if(m_definitions[i].arity > 0){ os << "ObjectPtr f" << i << "(const NodePtr *x);" << std::endl; }
+		}
+		os << std::endl << functions.str();
+		os << "}" << std::endl << std::endl;
+		os << "void register_compiled_program(Interpreter& interp){" << std::endl;
+		os << "\tusing namespace compiled;" << std::endl;
+		os << "\tfor(auto& s : slots){ s = make_counted<Node>(); }" << std::endl;
+		for(size_t i = 0; i < m_constant_inits.size(); ++i){
+			os << "\tconstants[" << i << "] = " << m_constant_inits[i] << ";" << std::endl;
+		}
+		for(size_t i = 0; i < m_definitions.size(); ++i){
+			const auto& def = m_definitions[i];
+			if(def.arity > 0){
+				os << "\tslots[" << i << "]->kind  = Kind::OBJECT;" << std::endl;
+				os << "\tslots[" << i << "]->cache = make_counted<CompiledClosure>(f"
+				   << i << ", " << def.arity << ");" << std::endl;
+			}else{
+				os << "\tslots[" << i << "]->kind = Kind::APPLY;" << std::endl;
+				os << "\tslots[" << i << "]->fn   = make_reference_node(\"i\");" << std::endl;
+				os << "\tslots[" << i << "]->arg  = " << bodies[i] << ";" << std::endl;
+			}
+			os << "\tinterp.define_slot(\"" << escape(def.key) << "\", slots[" << i << "]);" << std::endl;
+		}
+		os << "}" << std::endl;
+	}
+
+};
+
+inline void Interpreter::write_compiled_program(const std::string& filename, const std::string& source) const {
+	CppTranslator translator;
+	for(const auto& kv : m_slots){
+		if(kv.second && kv.second->kind != Kind::OBJECT){ translator.add(kv.first, *kv.second); }
+	}
+	std::ofstream ofs(filename);
+	translator.write(ofs, source);
+}
+
+//----------------------------------------------------------------------------
+// Interpreter API
+//----------------------------------------------------------------------------
+inline Interpreter::Interpreter()
+	: m_slots()
+	, m_sources()
+	, m_references()
+	, m_referrers()
+	, m_roots()
+	, m_image_writer()
+	, m_history()
+	, m_print_options()
+{
+	auto state = make_counted<Node>();
+	state->kind  = Kind::OBJECT;
+	state->cache = make_counted<Nil>();
+	m_slots[":state"] = state;
+	m_history.reset(state->cache);
+}
+
+inline ObjectPtr Interpreter::evaluate(const std::string& expression){
+	Scope scope(*this);
+	Tokenizer tokens(expression);
+	return ::evaluate(make_counted<Node>(parse(tokens)));
+}
+
+inline ObjectPtr Interpreter::execute(const std::string& line){
+	Scope scope(*this);
+	std::string key;
+	const char *body = line.data();
+	const bool is_definition = (!line.empty() && line[0] == ':' && split_definition(line.data(), line.data() + line.size(), key, body));
+	Tokenizer tokens(body, line.data() + line.size());
+	auto root = make_counted<Node>(parse(tokens));
+	if(is_definition){
+		// ":x = ap inc :x" refers to the previous :x, which would otherwise be
+		// resolved lazily to the new definition of :x itself
+		const auto old = load_slot(key);
+		if(old){ bind_references(*root, key, ::evaluate(old)); }
+	}
+	auto value = ::evaluate(root);
+	if(is_definition){ define_slot(key, root); }
+	return value;
+}
+
+// Same as evaluating "ap ap ap interact <protocol> :state ap ap cons x y"
+inline ObjectPtr Interpreter::interact(const galaxy::Vec& click, const std::string& protocol){
+	Scope scope(*this);
+	auto vector = make_apply(make_apply(make_reference_node("cons"), make_number_node(click.x)), make_number_node(click.y));
+	auto root = make_apply(make_apply(make_apply(
+		make_reference_node("interact"), make_reference_node(protocol.c_str())),
+		make_reference_node(":state")), vector);
+	return ::evaluate(root);
+}
+
+inline galaxy::Element Interpreter::to_element(const ObjectPtr& value){
+	Scope scope(*this);
+	return ::to_element(value);
+}
+
+inline void Interpreter::print(std::ostream& os, const ObjectPtr& value){
+	Scope scope(*this);
+	print_object(os, value);
+}
+
+// Slots that refer to :state are invalidated like after any redefinition
+inline void Interpreter::set_state(ObjectPtr state){
+	define_slot(":state", as_node(std::move(state)));
+}
+
+inline bool Interpreter::restore(const Snapshot& snapshot){
+	if(!m_history.jump(snapshot.step)){ return false; }
+	set_state(snapshot.state);
+	return true;
+}
+
+inline void Interpreter::write_image(const std::string& filename){
+	m_image_writer.write(filename);
+	m_image_writer.reset();
+}
+
+#endif
@@ -0,0 +1,44 @@
+#!/bin/sh
+# Regression tests for the REPL: feeds commands to the interpreter and
+# compares what it prints.
+# usage: ./test_repl.sh
+
+set -e
+
+dir=$(cd "$(dirname "$0")" && pwd)
+work=$(mktemp -d)
+trap 'rm -rf "$work"' EXIT
+
+g++ -std=c++14 -O2 -pthread -o "$work/interpreter" "$dir/main.cpp" -lcurl
+: > "$work/empty.txt"
+
+failed=0
+
+# check name input expected
+check(){
+	actual=$(cd "$work" && printf "$2" | ./interpreter empty.txt 2>&1) || true
+	expected=$(printf "$3")
+	if [ "$actual" = "$expected" ]; then
+		echo "ok: $1"
+	else
+		echo "FAILED: $1"
+		echo "expected:"; echo "$expected"
+		echo "actual:";   echo "$actual"
+		failed=1
+	fi
+}
+
+check "redefine a slot from its previous value" \
+	':x = 1\n:x\n:x = ap inc :x\n:x\n:x = ap inc :x\n:x\n' \
+	'> 1\n> 1\n> 2\n> 2\n> 3\n> 3\n> '
+check "redefine a lazy structure from its previous value" \
+	':s = ap ap cons 1 nil\n:s = ap ap cons 2 :s\n:s\n' \
+	'> (1, nil)\n> (2, (1, nil))\n> (2, (1, nil))\n> '
+check "dependents see the redefinition" \
+	':x = 5\n:y = ap inc :x\n:y\n:x = ap inc :x\n:y\n' \
+	'> 5\n> 6\n> 6\n> 6\n> 7\n> '
+check "jump to an invalid step" \
+	':jump abc\n:jump 5\n:x = 1\n' \
+	'> history: step 0 of [0, 0], 0 bytes\n> history: step 0 of [0, 0], 0 bytes\n> 1\n> '
+
+exit $failed
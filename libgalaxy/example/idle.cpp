@@ -2,7 +2,7 @@
 
 int main(int argc, char *argv[]){
 	if(argc < 3){
-		std::cerr << "Usage: " << argv[0] << " endpoint player_key" << std::endl;
+		std::cerr << "Usage: " << argv[0] << " endpoint player_key [traffic_log]" << std::endl;
 		return 0;
 	}
 
@@ -12,6 +12,7 @@ int main(int argc, char *argv[]){
 	const long player_key = atol(argv[2]);
 
 	galaxy::GalaxyContext ctx(endpoint, player_key);
+	if(argc >= 4){ ctx.record(std::make_shared<galaxy::TrafficRecorder>(argv[3])); }
 
 	// Response
 	galaxy::GameResponse res;
@@ -33,6 +34,7 @@ int main(int argc, char *argv[]){
 		galaxy::CommandListBuilder cmds;
 		res = ctx.command(cmds);
 	}
+	ctx.stats().dump(std::cerr);
 
 	galaxy::global_finalize();
 	return 0;
@@ -0,0 +1,44 @@
+// g++ -std=c++14 -pthread -I ../include -I ../../app local_server.cpp -lcurl
+#include "httplib.h"
+#include "galaxy_local_server.hpp"
+
+// Serves the local simulator on http://host:port/ for any path.
+// Every connected player holds a server thread, so `threads` must be at
+// least twice the number of concurrent matches.
+int main(int argc, char *argv[]){
+	if(argc < 2){
+		std::cerr << "Usage: " << argv[0] << " port [threads] [seed]" << std::endl;
+		return 0;
+	}
+
+	const int port = std::stoi(argv[1]);
+	const size_t threads = (argc >= 3 ? std::stoul(argv[2]) : 64);
+	const uint64_t seed = (argc >= 4 ? std::stoull(argv[3]) : 0);
+
+	galaxy::LocalServer local(galaxy::GameRules(), seed);
+
+	httplib::Server server;
+	server.new_task_queue = [threads]{ return new httplib::ThreadPool(threads); };
+	server.set_keep_alive_max_count(1 << 20);
+	server.set_tcp_nodelay(true);
+	server.Post(".*", [&local](const httplib::Request& req, httplib::Response& res){
+		res.set_content(local(req.body).get(), "text/plain");
+	});
+
+	// httplib listens with a backlog of 5, which drops connections when many
+	// players connect at once; widen it once the socket is bound.
+	socket_t listener = INVALID_SOCKET;
+	server.set_socket_options([&listener](socket_t sock){
+		httplib::default_socket_options(sock);
+		listener = sock;
+	});
+	if(!server.bind_to_port("0.0.0.0", port)){
+		std::cerr << "failed to bind port " << port << std::endl;
+		return 1;
+	}
+	::listen(listener, SOMAXCONN);
+
+	std::cerr << "listening on port " << port << std::endl;
+	server.listen_after_bind();
+	return 0;
+}
@@ -0,0 +1,43 @@
+#include <chrono>
+#include "galaxy.hpp"
+
+// Usage: modem_bench [iterations] < serialized_element
+// Prints modulate/demodulate throughput in MB/s of signal text.
+int main(int argc, char *argv[]){
+	galaxy::global_initialize();
+
+	const size_t iterations = (argc >= 2 ? std::stoul(argv[1]) : 1000);
+
+	std::string line;
+	std::getline(std::cin, line);
+
+	const auto des = galaxy::deserialize(line);
+	const auto mod = galaxy::modulate(des);
+
+	using clock = std::chrono::steady_clock;
+	size_t checksum = 0;
+
+	const auto mod_begin = clock::now();
+	for(size_t i = 0; i < iterations; ++i){
+		checksum += galaxy::modulate(des).size();
+	}
+	const auto mod_end = clock::now();
+
+	const auto dem_begin = clock::now();
+	for(size_t i = 0; i < iterations; ++i){
+		checksum += galaxy::demodulate(mod).is_list();
+	}
+	const auto dem_end = clock::now();
+
+	const auto throughput = [&](clock::duration d){
+		const double seconds = std::chrono::duration<double>(d).count();
+		return static_cast<double>(mod.size()) * iterations / seconds / 1e6;
+	};
+	std::cout << "signal:     " << mod.size() << " bytes x " << iterations << std::endl;
+	std::cout << "modulate:   " << throughput(mod_end - mod_begin) << " MB/s" << std::endl;
+	std::cout << "demodulate: " << throughput(dem_end - dem_begin) << " MB/s" << std::endl;
+	std::cerr << "checksum: " << checksum << std::endl;
+
+	galaxy::global_finalize();
+	return 0;
+}
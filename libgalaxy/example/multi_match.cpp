@@ -0,0 +1,79 @@
+#include <deque>
+#include "galaxy_local_server.hpp"
+
+// Runs `matches` idle-vs-idle games concurrently from one thread.
+// Every session shares the connections of one AsyncQueryEngine, or the
+// in-process simulator when the endpoint is "local".
+int main(int argc, char *argv[]){
+	if(argc < 3){
+		std::cerr << "Usage: " << argv[0] << " endpoint|local matches [connections]" << std::endl;
+		return 0;
+	}
+
+	galaxy::global_initialize();
+
+	const std::string endpoint = argv[1];
+	const size_t matches = std::stoul(argv[2]);
+	const size_t connections = (argc >= 4 ? std::stoul(argv[3]) : 2 * matches);
+
+	{
+		std::unique_ptr<galaxy::AsyncQueryEngine> engine;
+		galaxy::QueryFunction query = galaxy::LocalServer();
+		if(endpoint != "local"){
+			engine.reset(new galaxy::AsyncQueryEngine(endpoint, connections));
+			auto e = engine.get();
+			query = [e](const std::string& body, galaxy::HttpTiming *timing){ return e->post(body, timing); };
+		}
+
+		struct Player {
+			galaxy::GalaxyContext ctx;
+			long key;
+			bool started;
+			std::future<galaxy::GameResponse> pending;
+
+			Player(const galaxy::QueryFunction& query, long key)
+				: ctx(query, key)
+				, key(key)
+				, started(false)
+				, pending()
+			{ }
+		};
+
+		// Create rooms
+		std::deque<Player> players;
+		galaxy::GalaxyContext lobby(query, 0);
+		for(size_t i = 0; i < matches; ++i){
+			const auto room = lobby.create_room();
+			players.emplace_back(query, room.attacker_key);
+			players.emplace_back(query, room.defender_key);
+		}
+
+		// Join
+		for(auto& p : players){ p.pending = p.ctx.join_async(); }
+
+		// Start and command loop: every player always has one query in flight
+		galaxy::ShipParams ship_params;
+		ship_params.x3 = 1;
+		size_t active = players.size();
+		while(active > 0){
+			for(size_t i = 0; i < players.size(); ++i){
+				auto& p = players[i];
+				if(!p.pending.valid()){ continue; }
+				const auto res = p.pending.get();
+				if(!p.started){
+					p.started = true;
+					p.pending = p.ctx.start_async(ship_params);
+				}else if(res.stage == galaxy::GameStage::RUNNING){
+					p.pending = p.ctx.command_async(galaxy::CommandListBuilder());
+				}else{
+					std::cout << "match " << i / 2 << " player " << p.key
+					          << ": " << res.stage << " at " << res.state.elapsed << std::endl;
+					--active;
+				}
+			}
+		}
+	}
+
+	galaxy::global_finalize();
+	return 0;
+}
@@ -0,0 +1,72 @@
+#include "galaxy_planner.hpp"
+#include "galaxy_scheduler.hpp"
+
+using Vec = galaxy::Vec;
+
+// Usage: orbit endpoint player_key [budget_ms]
+// Keeps every own ship on an orbit that survives until the end of the game.
+// Each turn the planner runs with a deepening thrust horizon until the
+// budget measured from the arrival of the previous response runs out.
+int main(int argc, char *argv[]){
+	if(argc < 3){
+		std::cerr << "Usage: " << argv[0] << " endpoint player_key [budget_ms]" << std::endl;
+		return 0;
+	}
+
+	galaxy::global_initialize();
+
+	const std::string endpoint = argv[1];
+	const long player_key = atol(argv[2]);
+	const std::chrono::milliseconds budget(argc >= 4 ? atol(argv[3]) : 100);
+
+	galaxy::GalaxyContext ctx(endpoint, player_key);
+
+	// Response
+	galaxy::GameResponse res;
+
+	// Join
+	res = ctx.join();
+	const auto self_role = res.static_info.self_role;
+
+	// Start
+	galaxy::ShipParams ship_params;
+	ship_params.x0 = (self_role == galaxy::PlayerRole::ATTACKER ? 510 : 446) - 120;  // TODO
+	ship_params.x1 = 0;
+	ship_params.x2 = 10;
+	ship_params.x3 = 1;
+	res = ctx.start(ship_params);
+
+	const auto& info = res.static_info;
+	galaxy::OrbitPlanner planner(info.universe_radius, info.galaxy_radius);
+	galaxy::TurnScheduler scheduler(budget);
+	const long HORIZON_STEP = 4;
+
+	// Command loop
+	while(res.stage == galaxy::GameStage::RUNNING){
+		const long turns = info.time_limit - res.state.elapsed;
+		const auto search = [&](long depth, galaxy::TurnScheduler::clock::time_point deadline, galaxy::CommandListBuilder& cmds){
+			auto options = planner.options();
+			options.max_depth = depth * HORIZON_STEP;
+			planner.set_options(options);
+			bool deeper = false;
+			for(const auto& sac : res.state.ships){
+				const auto& ship = sac.ship;
+				if(ship.role != self_role){ continue; }
+				const auto plan = planner.plan(ship.pos, ship.vel, turns, ship.params.x0, deadline);
+				if(!plan.complete){ return galaxy::IterationResult::TIMED_OUT; }
+				if(plan.depth >= options.max_depth){ deeper = true; }
+				if(!plan.accels.empty() && (plan.accels[0].x != 0 || plan.accels[0].y != 0)){
+					cmds.accel(ship.id, plan.accels[0]);
+				}
+			}
+			return deeper ? galaxy::IterationResult::DEEPER : galaxy::IterationResult::DONE;
+		};
+		const auto cmds = scheduler.run(ctx, search, galaxy::CommandListBuilder(), turns);
+		std::cerr << "turn " << res.state.elapsed << ": depth " << scheduler.depth() * HORIZON_STEP << std::endl;
+		res = ctx.command(cmds);
+	}
+	std::cerr << "overruns: " << scheduler.overruns() << " / " << scheduler.turns() << std::endl;
+
+	galaxy::global_finalize();
+	return 0;
+}
@@ -0,0 +1,130 @@
+#include <random>
+#include "galaxy_planner.hpp"
+
+// Usage: orbit_planner [states] [budget_ms] [survival_table]
+// Compares OrbitPlanner with an exhaustive search over 3 turns of thrust,
+// as used by the bots during the contest, on random states near spawn.
+namespace {
+
+using galaxy::Vec;
+
+long coast(Vec p, Vec v, long turns, long ur, long gr){
+	long lifetime = 0;
+	galaxy::rules::trace(p, v, turns, ur, gr, &lifetime);
+	return lifetime;
+}
+
+// Cheapest plan of at most `depth` turns, without deduplication
+bool exhaustive(const Vec& p, const Vec& v, long turns, long depth, long ur, long gr, long *fuel){
+	if(coast(p, v, turns, ur, gr) >= turns){
+		*fuel = 0;
+		return true;
+	}
+	if(depth == 0){ return false; }
+	bool found = false;
+	for(long ay = -1; ay <= 1; ++ay){
+		for(long ax = -1; ax <= 1; ++ax){
+			const long cost = std::max(std::abs(ax), std::abs(ay));
+			const auto next = galaxy::rules::simulate(p, Vec(v.x - ax, v.y - ay));
+			const long r = std::max(std::abs(next.first.x), std::abs(next.first.y));
+			if(r <= gr || r > ur){ continue; }
+			long f = 0;
+			if(exhaustive(next.first, next.second, turns - 1, depth - 1, ur, gr, &f) && (!found || cost + f < *fuel)){
+				*fuel = cost + f;
+				found = true;
+			}
+		}
+	}
+	return found;
+}
+
+}
+
+int main(int argc, char *argv[]){
+	const size_t num_states = (argc >= 2 ? std::stoul(argv[1]) : 200);
+	const double budget_ms = (argc >= 3 ? std::stod(argv[2]) : 50.0);
+	const long ur = 128, gr = 16, turns = 256, spawn = 48;
+	std::unique_ptr<galaxy::SurvivalTable> table;
+	if(argc >= 4){ table.reset(new galaxy::SurvivalTable(galaxy::SurvivalTable::open(argv[3]))); }
+
+	std::mt19937_64 rng(0);
+	std::uniform_int_distribution<long> side_dist(-spawn, spawn), vel_dist(-2, 2);
+	std::vector<std::pair<Vec, Vec>> states;
+	for(size_t i = 0; i < num_states; ++i){
+		const long s = side_dist(rng);
+		Vec p;
+		switch(rng() % 4){
+			case 0:  p = Vec(s, spawn); break;
+			case 1:  p = Vec(s, -spawn); break;
+			case 2:  p = Vec(spawn, s); break;
+			default: p = Vec(-spawn, s); break;
+		}
+		states.emplace_back(p, Vec(vel_dist(rng), vel_dist(rng)));
+	}
+
+	using clock = std::chrono::steady_clock;
+	const auto seconds = [](clock::duration d){ return std::chrono::duration<double>(d).count(); };
+
+	size_t solved[2] = { 0, 0 };
+	long fuel[2] = { 0, 0 }, both_fuel[2] = { 0, 0 };
+	size_t both = 0, costlier = 0;  // states both solve, and those where the planner spends more
+	double elapsed[2] = { 0.0, 0.0 }, worst[2] = { 0.0, 0.0 };
+	galaxy::OrbitPlanner planner(ur, gr, galaxy::OrbitSearchOptions(), table.get());
+	for(const auto& s : states){
+		const auto exhaustive_begin = clock::now();
+		long f = 0;
+		const bool ok = exhaustive(s.first, s.second, turns, 3, ur, gr, &f);
+		const auto exhaustive_end = clock::now();
+		const auto deadline = exhaustive_end + std::chrono::duration_cast<clock::duration>(
+			std::chrono::duration<double, std::milli>(budget_ms));
+		const auto plan = planner.plan(s.first, s.second, turns, 1 << 20, deadline);
+		const auto planner_end = clock::now();
+
+		const double t[2] = { seconds(exhaustive_end - exhaustive_begin), seconds(planner_end - exhaustive_end) };
+		for(int k = 0; k < 2; ++k){
+			elapsed[k] += t[k];
+			worst[k] = std::max(worst[k], t[k]);
+		}
+		if(ok){ ++solved[0]; fuel[0] += f; }
+		if(plan.found){ ++solved[1]; fuel[1] += plan.fuel; }
+		if(ok && plan.found){
+			++both;
+			both_fuel[0] += f;
+			both_fuel[1] += plan.fuel;
+			if(plan.fuel > f){ ++costlier; }
+		}
+
+		// A plan has to survive when replayed
+		if(plan.found){
+			Vec p = s.first, v = s.second;
+			long lifetime = 0;
+			for(const auto& a : plan.accels){
+				const auto next = galaxy::rules::simulate(p, Vec(v.x - a.x, v.y - a.y));
+				p = next.first;
+				v = next.second;
+				const long r = std::max(std::abs(p.x), std::abs(p.y));
+				if(r <= gr || r > ur){ break; }
+				++lifetime;
+			}
+			if(lifetime != static_cast<long>(plan.accels.size()) ||
+			   coast(p, v, turns - lifetime, ur, gr) < turns - lifetime)
+			{
+				std::cerr << "invalid plan from (" << s.first.x << ", " << s.first.y << ") ("
+				          << s.second.x << ", " << s.second.y << ")" << std::endl;
+				return 1;
+			}
+		}
+	}
+
+	const char *names[2] = { "exhaustive(3)", "planner" };
+	for(int k = 0; k < 2; ++k){
+		std::cout << names[k] << ": solved " << solved[k] << " / " << num_states
+		          << ", mean fuel " << (solved[k] ? double(fuel[k]) / solved[k] : 0.0)
+		          << ", mean " << elapsed[k] / num_states * 1e3 << " ms"
+		          << ", max " << worst[k] * 1e3 << " ms" << std::endl;
+	}
+	std::cout << "total fuel on the " << both << " states both solve: "
+	          << names[0] << " " << both_fuel[0] << ", " << names[1] << " " << both_fuel[1]
+	          << " (planner spends more on " << costlier << ")" << std::endl;
+	return 0;
+}
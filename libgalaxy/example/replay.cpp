@@ -0,0 +1,40 @@
+#include "galaxy.hpp"
+
+// Re-runs the idle bot against a log written by `idle endpoint player_key traffic_log`
+int main(int argc, char *argv[]){
+	if(argc < 3){
+		std::cerr << "Usage: " << argv[0] << " traffic_log player_key" << std::endl;
+		return 0;
+	}
+
+	const long player_key = atol(argv[2]);
+
+	galaxy::ReplayTransport replay(argv[1], galaxy::ReplayTransport::Mode::KEYED);
+	std::cerr << "records: " << replay.size() << std::endl;
+
+	galaxy::GalaxyContext ctx(replay, player_key);
+
+	// Response
+	galaxy::GameResponse res;
+
+	// Join
+	res = ctx.join();
+
+	// Start
+	galaxy::ShipParams ship_params;
+	ship_params.x0 = 0;
+	ship_params.x1 = 0;
+	ship_params.x2 = 0;
+	ship_params.x3 = 1;
+	res = ctx.start(ship_params);
+
+	// Command loop
+	while(res.stage == galaxy::GameStage::RUNNING){
+		galaxy::CommandListBuilder cmds;
+		res = ctx.command(cmds);
+	}
+	res.dump(std::cout);
+	ctx.stats().dump(std::cerr);
+
+	return 0;
+}
@@ -0,0 +1,72 @@
+#include <chrono>
+#include <random>
+#include "galaxy_survival.hpp"
+
+// Usage:
+//   survival_table build path universe_radius galaxy_radius max_speed [horizon] [threads]
+//   survival_table query path < "px py vx vy" lines
+//   survival_table bench path [lookups]
+int main(int argc, char *argv[]){
+	if(argc < 3){
+		std::cerr << "Usage: " << argv[0] << " build|query|bench path ..." << std::endl;
+		return 0;
+	}
+	const std::string mode = argv[1], path = argv[2];
+	using clock = std::chrono::steady_clock;
+
+	if(mode == "build"){
+		if(argc < 6){
+			std::cerr << "Usage: " << argv[0] << " build path universe_radius galaxy_radius max_speed [horizon] [threads]" << std::endl;
+			return 0;
+		}
+		const auto begin = clock::now();
+		const galaxy::SurvivalTable table(
+			std::stol(argv[3]), std::stol(argv[4]), std::stol(argv[5]),
+			(argc >= 7 ? std::stol(argv[6]) : 256),
+			(argc >= 8 ? std::stoul(argv[7]) : 0));
+		const auto end = clock::now();
+		table.save(path);
+		std::cerr << "built in " << std::chrono::duration<double>(end - begin).count() << " s" << std::endl;
+		return 0;
+	}
+
+	const auto table = galaxy::SurvivalTable::open(path);
+	if(mode == "query"){
+		galaxy::Vec p, v;
+		while(std::cin >> p.x >> p.y >> v.x >> v.y){
+			std::cout << table.lifetime(p, v) << std::endl;
+		}
+	}else if(mode == "bench"){
+		const size_t lookups = (argc >= 4 ? std::stoul(argv[3]) : 1000000);
+		const long ur = table.universe_radius(), vm = table.max_speed();
+		std::mt19937_64 rng(0);
+		std::uniform_int_distribution<long> pos_dist(-ur, ur), vel_dist(-vm, vm);
+		std::vector<std::pair<galaxy::Vec, galaxy::Vec>> states;
+		for(size_t i = 0; i < lookups; ++i){
+			states.emplace_back(galaxy::Vec(pos_dist(rng), pos_dist(rng)), galaxy::Vec(vel_dist(rng), vel_dist(rng)));
+		}
+		long checksum[2] = { 0, 0 };
+		const auto trace_begin = clock::now();
+		for(const auto& s : states){
+			galaxy::Vec p = s.first, v = s.second;
+			long lifetime = 0;
+			if(std::max(std::abs(p.x), std::abs(p.y)) > table.galaxy_radius()){
+				galaxy::rules::trace(p, v, table.horizon(), ur, table.galaxy_radius(), &lifetime);
+			}
+			checksum[0] += lifetime;
+		}
+		const auto trace_end = clock::now();
+		for(const auto& s : states){ checksum[1] += table.lifetime(s.first, s.second); }
+		const auto lookup_end = clock::now();
+		const auto per_query = [&](clock::duration d){
+			return std::chrono::duration<double>(d).count() / lookups * 1e9;
+		};
+		std::cout << "trace:  " << per_query(trace_end - trace_begin) << " ns/query" << std::endl;
+		std::cout << "lookup: " << per_query(lookup_end - trace_end) << " ns/query" << std::endl;
+		if(checksum[0] != checksum[1]){
+			std::cerr << "mismatch: " << checksum[0] << " != " << checksum[1] << std::endl;
+			return 1;
+		}
+	}
+	return 0;
+}
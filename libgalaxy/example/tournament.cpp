@@ -0,0 +1,265 @@
+// g++ -std=c++14 -O2 -pthread -I ../include -I ../../app tournament.cpp -lcurl
+#include <cmath>
+#include <iomanip>
+#include <fcntl.h>
+#include <spawn.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include "httplib.h"
+#include "galaxy_local_server.hpp"
+
+extern char **environ;
+
+// Plays every ordered pair of bot executables against each other on a local
+// server. A bot is any program taking `endpoint player_key` arguments; bots
+// with randomness should seed it from the GALAXY_SEED environment variable.
+// Match i uses the i-th seed drawn from --seed and ratings are updated in
+// match order, so the report only depends on the seed and the bots.
+
+namespace {
+
+using galaxy::RoomInfo;
+using galaxy::PlayerRole;
+
+struct Options {
+	uint64_t                 seed;
+	size_t                   rounds;
+	size_t                   workers;
+	int                      port;
+	double                   timeout;
+	std::vector<std::string> bots;
+
+	Options()
+		: seed(0)
+		, rounds(1)
+		, workers(std::max(1u, std::thread::hardware_concurrency()))
+		, port(0)
+		, timeout(60.0)
+		, bots()
+	{ }
+};
+
+struct Match {
+	size_t   attacker;
+	size_t   defender;
+	uint64_t seed;
+	RoomInfo room;
+	PlayerRole winner;
+	long     ticks;
+	bool     forfeit;
+};
+
+pid_t spawn_bot(const std::string& path, const std::string& endpoint, long key, uint64_t seed){
+	posix_spawn_file_actions_t actions;
+	posix_spawn_file_actions_init(&actions);
+	posix_spawn_file_actions_addopen(&actions, 1, "/dev/null", O_WRONLY, 0);
+	posix_spawn_file_actions_addopen(&actions, 2, "/dev/null", O_WRONLY, 0);
+	const std::string key_str = std::to_string(key);
+	char *argv[] = {
+		const_cast<char*>(path.c_str()),
+		const_cast<char*>(endpoint.c_str()),
+		const_cast<char*>(key_str.c_str()),
+		nullptr
+	};
+	std::vector<std::string> env_strings;
+	for(char **e = environ; *e; ++e){
+		if(std::strncmp(*e, "GALAXY_SEED=", 12) != 0){ env_strings.push_back(*e); }
+	}
+	env_strings.push_back("GALAXY_SEED=" + std::to_string(seed));
+	std::vector<char*> env;
+	for(auto& e : env_strings){ env.push_back(&e[0]); }
+	env.push_back(nullptr);
+	pid_t pid = 0;
+	const int err = posix_spawn(&pid, path.c_str(), &actions, nullptr, argv, env.data());
+	posix_spawn_file_actions_destroy(&actions);
+	if(err != 0){
+		throw std::runtime_error("failed to spawn " + path + ": " + std::strerror(err));
+	}
+	return pid;
+}
+
+// Runs both bots to completion. A bot exiting before the game ends forfeits
+// it; on timeout both are killed and the attacker forfeits unless the game
+// has already ended.
+void play(galaxy::LocalServer& server, const Options& opts, const std::string& endpoint, Match& m){
+	const long keys[2] = { m.room.attacker_key, m.room.defender_key };
+	pid_t pids[2] = {
+		spawn_bot(opts.bots[m.attacker], endpoint, keys[0], m.seed),
+		spawn_bot(opts.bots[m.defender], endpoint, keys[1], m.seed ^ 1)
+	};
+	const auto deadline = std::chrono::steady_clock::now() + std::chrono::duration<double>(opts.timeout);
+	m.forfeit = false;
+	while(pids[0] > 0 || pids[1] > 0){
+		for(int i = 0; i < 2; ++i){
+			if(pids[i] <= 0){ continue; }
+			int status = 0;
+			if(waitpid(pids[i], &status, WNOHANG) != pids[i]){ continue; }
+			pids[i] = 0;
+			if(server.stage(keys[i]) != galaxy::GameStage::COMPLETED){
+				server.resign(keys[i]);
+				m.forfeit = true;
+			}
+		}
+		if(std::chrono::steady_clock::now() > deadline){
+			if(server.stage(keys[0]) != galaxy::GameStage::COMPLETED){
+				server.resign(keys[0]);
+				m.forfeit = true;
+			}
+			for(int i = 0; i < 2; ++i){
+				if(pids[i] <= 0){ continue; }
+				kill(pids[i], SIGKILL);
+				waitpid(pids[i], nullptr, 0);
+				pids[i] = 0;
+			}
+		}
+		std::this_thread::sleep_for(std::chrono::milliseconds(5));
+	}
+	m.winner = server.winner(keys[0]);
+	m.ticks  = server.tick(keys[0]);
+}
+
+Options parse_options(int argc, char *argv[]){
+	Options opts;
+	for(int i = 1; i < argc; ++i){
+		const std::string arg = argv[i];
+		if(arg == "--seed" && i + 1 < argc){
+			opts.seed = std::stoull(argv[++i]);
+		}else if(arg == "--rounds" && i + 1 < argc){
+			opts.rounds = std::stoul(argv[++i]);
+		}else if(arg == "--workers" && i + 1 < argc){
+			opts.workers = std::max<size_t>(1, std::stoul(argv[++i]));
+		}else if(arg == "--port" && i + 1 < argc){
+			opts.port = std::stoi(argv[++i]);
+		}else if(arg == "--timeout" && i + 1 < argc){
+			opts.timeout = std::stod(argv[++i]);
+		}else{
+			opts.bots.push_back(arg);
+		}
+	}
+	return opts;
+}
+
+}
+
+int main(int argc, char *argv[]){
+	const auto opts = parse_options(argc, argv);
+	if(opts.bots.size() < 2){
+		std::cerr << "Usage: " << argv[0] << " [--seed n] [--rounds n] [--workers n] [--port n] [--timeout sec] bot bot..." << std::endl;
+		return 0;
+	}
+	const size_t num_bots = opts.bots.size();
+
+	galaxy::global_initialize();
+
+	// Server: every worker keeps two requests blocked while a turn is pending
+	galaxy::LocalServer local(galaxy::GameRules(), opts.seed);
+	httplib::Server server;
+	const size_t threads = 4 * opts.workers + 4;
+	server.new_task_queue = [threads]{ return new httplib::ThreadPool(threads); };
+	server.set_keep_alive_max_count(1 << 20);
+	server.set_tcp_nodelay(true);
+	server.Post(".*", [&local](const httplib::Request& req, httplib::Response& res){
+		res.set_content(local(req.body).get(), "text/plain");
+	});
+	socket_t listener = INVALID_SOCKET;
+	server.set_socket_options([&listener](socket_t sock){
+		httplib::default_socket_options(sock);
+		listener = sock;
+	});
+	const int port = (opts.port > 0
+		? (server.bind_to_port("127.0.0.1", opts.port) ? opts.port : -1)
+		: server.bind_to_any_port("127.0.0.1"));
+	if(port < 0){
+		std::cerr << "failed to bind port " << opts.port << std::endl;
+		return 1;
+	}
+	::listen(listener, SOMAXCONN);
+	std::thread server_thread([&server]{ server.listen_after_bind(); });
+	const std::string endpoint = "http://127.0.0.1:" + std::to_string(port) + "/";
+
+	// Schedule
+	std::mt19937_64 rng(opts.seed);
+	std::vector<Match> matches;
+	for(size_t r = 0; r < opts.rounds; ++r){
+		for(size_t a = 0; a < num_bots; ++a){
+			for(size_t d = 0; d < num_bots; ++d){
+				if(a == d){ continue; }
+				Match m;
+				m.attacker = a;
+				m.defender = d;
+				m.seed     = rng();
+				m.room     = local.create_room(m.seed);
+				matches.push_back(m);
+			}
+		}
+	}
+
+	// Play
+	const auto begin = std::chrono::steady_clock::now();
+	std::atomic<size_t> next(0);
+	std::vector<std::thread> workers;
+	for(size_t w = 0; w < std::min(opts.workers, matches.size()); ++w){
+		workers.emplace_back([&]{
+			for(size_t i = next++; i < matches.size(); i = next++){
+				play(local, opts, endpoint, matches[i]);
+				std::cerr << "\r" << i + 1 << " / " << matches.size() << std::flush;
+			}
+		});
+	}
+	for(auto& t : workers){ t.join(); }
+	const double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+	std::cerr << std::endl;
+	server.stop();
+	server_thread.join();
+
+	// Ratings and statistics, in match order
+	const double K = 16.0;
+	std::vector<double> elo(num_bots, 1500.0);
+	std::vector<size_t> games(num_bots), wins(num_bots), attacks(num_bots), attack_wins(num_bots), forfeits(num_bots);
+	std::vector<galaxy::LatencyHistogram> latency(num_bots);
+	for(const auto& m : matches){
+		const size_t a = m.attacker, d = m.defender;
+		const bool attacker_won = (m.winner == PlayerRole::ATTACKER);
+		const size_t w = (attacker_won ? a : d);
+		std::cout << "match " << (&m - matches.data()) << " seed " << m.seed << ": "
+		          << opts.bots[a] << " vs " << opts.bots[d] << " -> " << opts.bots[w]
+		          << " at " << m.ticks << (m.forfeit ? " (forfeit)" : "") << std::endl;
+
+		const double expected = 1.0 / (1.0 + std::pow(10.0, (elo[d] - elo[a]) / 400.0));
+		const double delta = K * ((attacker_won ? 1.0 : 0.0) - expected);
+		elo[a] += delta;
+		elo[d] -= delta;
+
+		++games[a]; ++games[d]; ++attacks[a]; ++wins[w];
+		if(attacker_won){ ++attack_wins[a]; }
+		if(m.forfeit){ ++forfeits[attacker_won ? d : a]; }
+		latency[a].merge(local.turn_latency(m.room.attacker_key));
+		latency[d].merge(local.turn_latency(m.room.defender_key));
+	}
+
+	std::cout << std::endl << matches.size() << " matches in " << elapsed << " s with "
+	          << opts.workers << " workers" << std::endl;
+	std::cout << std::left << std::setw(32) << "bot" << std::right
+	          << std::setw(8) << "elo" << std::setw(8) << "win%" << std::setw(8) << "atk%"
+	          << std::setw(8) << "def%" << std::setw(6) << "ff"
+	          << std::setw(10) << "turn ms" << std::setw(10) << "p99 ms" << std::setw(10) << "max ms" << std::endl;
+	std::vector<size_t> order(num_bots);
+	for(size_t i = 0; i < num_bots; ++i){ order[i] = i; }
+	std::sort(order.begin(), order.end(), [&](size_t x, size_t y){ return elo[x] > elo[y]; });
+	const auto percent = [](size_t n, size_t d){ return d == 0 ? 0.0 : 100.0 * n / d; };
+	for(const size_t i : order){
+		const size_t defends = games[i] - attacks[i];
+		std::cout << std::left << std::setw(32) << opts.bots[i] << std::right << std::fixed << std::setprecision(1)
+		          << std::setw(8) << elo[i]
+		          << std::setw(8) << percent(wins[i], games[i])
+		          << std::setw(8) << percent(attack_wins[i], attacks[i])
+		          << std::setw(8) << percent(wins[i] - attack_wins[i], defends)
+		          << std::setw(6) << forfeits[i] << std::setprecision(3)
+		          << std::setw(10) << latency[i].mean() * 1e-6
+		          << std::setw(10) << latency[i].percentile(0.99) * 1e-6
+		          << std::setw(10) << latency[i].max() * 1e-6 << std::endl;
+	}
+
+	galaxy::global_finalize();
+	return 0;
+}
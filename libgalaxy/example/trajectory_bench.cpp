@@ -0,0 +1,57 @@
+#include <chrono>
+#include <random>
+#include "galaxy_trajectory.hpp"
+
+// Usage: trajectory_bench [candidates] [steps]
+// Compares stepping candidates one Vec at a time with TrajectoryBatch.
+// Build with -march=native to enable the AVX2 kernel.
+int main(int argc, char *argv[]){
+	const size_t candidates = (argc >= 2 ? std::stoul(argv[1]) : 100000);
+	const size_t steps = (argc >= 3 ? std::stoul(argv[2]) : 256);
+	const long universe_radius = 128, galaxy_radius = 16;
+
+	std::mt19937_64 rng(0);
+	std::uniform_int_distribution<long> pos_dist(-universe_radius, universe_radius), vel_dist(-8, 8);
+	std::vector<std::pair<galaxy::Vec, galaxy::Vec>> initial;
+	for(size_t i = 0; i < candidates; ++i){
+		initial.emplace_back(galaxy::Vec(pos_dist(rng), pos_dist(rng)), galaxy::Vec(vel_dist(rng), vel_dist(rng)));
+	}
+
+	using clock = std::chrono::steady_clock;
+	long checksum[2] = { 0, 0 };
+
+	const auto scalar_begin = clock::now();
+	for(const auto& c : initial){
+		galaxy::Vec p = c.first, d = c.second;
+		long lifetime = 0;
+		galaxy::rules::trace(p, d, steps, universe_radius, galaxy_radius, &lifetime);
+		checksum[0] += lifetime;
+	}
+	const auto scalar_end = clock::now();
+
+	const auto batch_begin = clock::now();
+	galaxy::TrajectoryBatch batch;
+	batch.reserve(candidates);
+	for(const auto& c : initial){ batch.add(c.first, c.second); }
+	batch.run(steps, universe_radius, galaxy_radius);
+	for(size_t i = 0; i < candidates; ++i){ checksum[1] += batch.lifetime(i); }
+	const auto batch_end = clock::now();
+
+	const auto rate = [&](clock::duration d){
+		return checksum[0] / std::chrono::duration<double>(d).count() / 1e6;
+	};
+	std::cout << "candidates: " << candidates << " x " << steps << " steps, "
+	          << checksum[0] << " steps survived" << std::endl;
+	std::cout << "scalar:     " << rate(scalar_end - scalar_begin) << " Msteps/s" << std::endl;
+#ifdef __AVX2__
+	std::cout << "batch avx2: ";
+#else
+	std::cout << "batch:      ";
+#endif
+	std::cout << rate(batch_end - batch_begin) << " Msteps/s" << std::endl;
+	if(checksum[0] != checksum[1]){
+		std::cerr << "mismatch: " << checksum[0] << " != " << checksum[1] << std::endl;
+		return 1;
+	}
+	return 0;
+}
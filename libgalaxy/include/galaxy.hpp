@@ -3,12 +3,31 @@
 
 #include <iostream>
 #include <sstream>
+#include <fstream>
+#include <algorithm>
 #include <array>
+#include <chrono>
 #include <string>
 #include <vector>
+#include <unordered_map>
 #include <memory>
+#include <deque>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <thread>
+#include <tuple>
+#include <utility>
+#include <type_traits>
+#include <atomic>
+#include <iterator>
+#include <initializer_list>
+#include <new>
 
 #include <cassert>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
 
 #include <curl/curl.h>
 
@@ -18,11 +37,11 @@ namespace galaxy {
 //----------------------------------------------------------------------------
 // Global initialization / finalization
 //----------------------------------------------------------------------------
-static void global_initialize(){
+inline void global_initialize(){
 	curl_global_init(CURL_GLOBAL_ALL);
 }
 
-static void global_finalize(){
+inline void global_finalize(){
 	curl_global_cleanup();
 }
 
@@ -56,67 +75,274 @@ struct Vec {
 };
 
 
+class Element;
+
+namespace detail {
+
+// Reference counted array of elements that backs list elements.
+// A decoded message keeps all of its lists in one block.
+struct ElementBlock {
+	std::atomic<long> references;
+	uint32_t          size;      // number of constructed items
+	uint32_t          capacity;
+
+	Element *items(){ return reinterpret_cast<Element*>(this + 1); }
+
+	static ElementBlock *allocate(size_t capacity);
+
+	static void retain(ElementBlock *block){
+		block->references.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	static void release(ElementBlock *block);
+};
+
+class ElementDecoder;
+
+}
+
+
+// Read-only view of the children of a list element
+class ElementList {
+
+private:
+	const Element *m_first;
+	size_t         m_size;
+
+public:
+	using const_iterator         = const Element*;
+	using const_reverse_iterator = std::reverse_iterator<const Element*>;
+
+	ElementList()
+		: m_first(nullptr)
+		, m_size(0)
+	{ }
+
+	ElementList(const Element *first, size_t size)
+		: m_first(first)
+		, m_size(size)
+	{ }
+
+	size_t size() const { return m_size; }
+	bool empty() const { return m_size == 0; }
+
+	inline const Element& operator[](size_t i) const;
+
+	const_iterator begin() const { return m_first; }
+	inline const_iterator end() const;
+	const_reverse_iterator rbegin() const { return const_reverse_iterator(end()); }
+	const_reverse_iterator rend() const { return const_reverse_iterator(begin()); }
+
+};
+
+
+// Tagged union of 24 bytes. Children of a list live in a shared
+// ElementBlock, so copying an element never copies its children.
 class Element {
 
+	friend class detail::ElementDecoder;
+
 private:
-	enum class ElementKind {
+	enum class ElementKind : uint8_t {
 		NIL    = 0,
 		NUMBER = 1,
 		VECTOR = 2,
 		LIST   = 3,
 	};
 
-	ElementKind          m_kind;
-	long                 m_number;
-	Vec                  m_vector;
-	std::vector<Element> m_list;
+	struct ListRef {
+		detail::ElementBlock *block;
+		const Element        *items;
+	};
+
+	ElementKind m_kind;
+	bool        m_owner;  // holds a reference to m_list.block
+	uint32_t    m_size;   // number of children of a list
+	union {
+		long    m_number;
+		Vec     m_vector;
+		ListRef m_list;
+	};
+
+	// List stored inside `block` itself; does not keep the block alive
+	Element(detail::ElementBlock *block, const Element *items, uint32_t size)
+		: m_kind(ElementKind::LIST)
+		, m_owner(false)
+		, m_size(size)
+		, m_list{ block, items }
+	{ }
+
+	void copy_from(const Element& e){
+		m_kind  = e.m_kind;
+		m_owner = false;
+		m_size  = e.m_size;
+		if(m_kind == ElementKind::LIST){
+			m_list = e.m_list;
+			if(m_list.block){
+				detail::ElementBlock::retain(m_list.block);
+				m_owner = true;
+			}
+		}else if(m_kind == ElementKind::VECTOR){
+			m_vector = e.m_vector;
+		}else{
+			m_number = e.m_number;
+		}
+	}
+
+	// Takes over the contents of `e` and leaves it nil
+	void steal(Element& e){
+		if(e.m_kind == ElementKind::LIST && e.m_owner){
+			m_kind  = ElementKind::LIST;
+			m_owner = true;
+			m_size  = e.m_size;
+			m_list  = e.m_list;
+			e.m_kind   = ElementKind::NIL;
+			e.m_owner  = false;
+			e.m_size   = 0;
+			e.m_number = 0;
+		}else{
+			copy_from(e);
+		}
+	}
+
+	void clear(){
+		if(m_kind == ElementKind::LIST && m_owner){
+			detail::ElementBlock::release(m_list.block);
+		}
+		m_kind   = ElementKind::NIL;
+		m_owner  = false;
+		m_size   = 0;
+		m_number = 0;
+	}
+
+	template <typename Iterator>
+	void assign_list(Iterator first, Iterator last){
+		m_kind  = ElementKind::LIST;
+		m_owner = false;
+		m_size  = static_cast<uint32_t>(std::distance(first, last));
+		m_list  = ListRef{ nullptr, nullptr };
+		if(m_size == 0){ return; }
+		auto block = detail::ElementBlock::allocate(m_size);
+		for(; first != last; ++first){
+			new(block->items() + block->size) Element(std::move(*first));
+			++block->size;
+		}
+		detail::ElementBlock::retain(block);
+		m_owner = true;
+		m_list  = ListRef{ block, block->items() };
+	}
 
 public:
 	Element()
 		: m_kind(ElementKind::NIL)
+		, m_owner(false)
+		, m_size(0)
 		, m_number(0)
-		, m_vector()
-		, m_list()
 	{ }
 
 	Element(long x)
 		: m_kind(ElementKind::NUMBER)
+		, m_owner(false)
+		, m_size(0)
 		, m_number(x)
-		, m_vector()
-		, m_list()
 	{ }
 
 	Element(Vec v)
 		: m_kind(ElementKind::VECTOR)
-		, m_number(0)
-		, m_vector(std::move(v))
-		, m_list()
+		, m_owner(false)
+		, m_size(0)
+		, m_vector(v)
 	{ }
 
 	Element(std::vector<Element> l)
-		: m_kind(ElementKind::LIST)
-		, m_number(0)
-		, m_vector()
-		, m_list(std::move(l))
-	{ }
+		: Element()
+	{
+		assign_list(l.begin(), l.end());
+	}
+
+	Element(std::initializer_list<Element> l)
+		: Element()
+	{
+		assign_list(l.begin(), l.end());
+	}
+
+	Element(const Element& e)
+		: Element()
+	{
+		copy_from(e);
+	}
+
+	Element(Element&& e) noexcept
+		: Element()
+	{
+		steal(e);
+	}
+
+	~Element(){ clear(); }
+
+	Element& operator=(const Element& e){
+		if(this != &e){
+			Element tmp(e);
+			clear();
+			steal(tmp);
+		}
+		return *this;
+	}
+
+	Element& operator=(Element&& e) noexcept {
+		if(this != &e){
+			clear();
+			steal(e);
+		}
+		return *this;
+	}
 
 	bool is_nil() const { return m_kind == ElementKind::NIL; }
 
 	bool is_number() const { return m_kind == ElementKind::NUMBER; }
-	long as_number() const { return m_number; }
+	long as_number() const { return m_kind == ElementKind::NUMBER ? m_number : 0; }
 
 	bool is_vector() const { return m_kind == ElementKind::VECTOR; }
-	const Vec& as_vector() const { return m_vector; }
+	Vec as_vector() const { return m_kind == ElementKind::VECTOR ? m_vector : Vec(); }
 
 	bool is_list() const { return m_kind == ElementKind::LIST; }
-	const std::vector<Element>& as_list() const { return m_list; }
+	ElementList as_list() const {
+		return m_kind == ElementKind::LIST ? ElementList(m_list.items, m_size) : ElementList();
+	}
 
 };
 
+inline const Element& ElementList::operator[](size_t i) const { return m_first[i]; }
+inline ElementList::const_iterator ElementList::end() const { return m_first + m_size; }
+
+namespace detail {
+
+static_assert(sizeof(ElementBlock) % alignof(Element) == 0, "elements must be aligned in blocks");
+
+inline ElementBlock *ElementBlock::allocate(size_t capacity){
+	void *p = std::malloc(sizeof(ElementBlock) + capacity * sizeof(Element));
+	if(!p){ throw std::bad_alloc(); }
+	auto block = new(p) ElementBlock();
+	block->references = 0;
+	block->size       = 0;
+	block->capacity   = static_cast<uint32_t>(capacity);
+	return block;
+}
+
+inline void ElementBlock::release(ElementBlock *block){
+	if(block->references.fetch_sub(1, std::memory_order_acq_rel) != 1){ return; }
+	auto items = block->items();
+	for(uint32_t i = 0; i < block->size; ++i){ items[i].~Element(); }
+	block->~ElementBlock();
+	std::free(block);
+}
+
+}
+
 
 namespace detail {
 
-static void serialize_recur(std::ostream& os, const Element& e){
+inline void serialize_recur(std::ostream& os, const Element& e){
 	if(e.is_nil()){
 		os << "nil ";
 	}else if(e.is_number()){
@@ -138,7 +364,7 @@ static void serialize_recur(std::ostream& os, const Element& e){
 
 }
 
-static std::string serialize(const Element& e){
+inline std::string serialize(const Element& e){
 	std::ostringstream oss;
 	detail::serialize_recur(oss, e);
 	return oss.str();
@@ -146,7 +372,7 @@ static std::string serialize(const Element& e){
 
 namespace detail {
 
-static Element deserialize_recur(std::istream& is){
+inline Element deserialize_recur(std::istream& is){
 	std::string token;
 	is >> token;
 	if(token == "nil"){
@@ -178,7 +404,7 @@ static Element deserialize_recur(std::istream& is){
 
 }
 
-static Element deserialize(const std::string& s){
+inline Element deserialize(const std::string& s){
 	std::istringstream iss(s);
 	return detail::deserialize_recur(iss);
 }
@@ -186,85 +412,519 @@ static Element deserialize(const std::string& s){
 
 namespace detail {
 
-static void modulate_recur(std::ostream& os, const Element& e){
+static constexpr uint64_t BYTE_LSB_MASK = 0x0101010101010101ull;
+
+// Signal text packed into 64-bit words, first character in the MSB.
+class BitReader {
+
+private:
+	std::vector<uint64_t> m_words;  // one zero word of padding at the end
+	size_t m_size;
+	size_t m_pos;
+
+	uint64_t word_at(size_t pos) const {
+		const size_t w = pos / 64, o = pos % 64;
+		if(o == 0){ return m_words[w]; }
+		return (m_words[w] << o) | (m_words[w + 1] >> (64 - o));
+	}
+
+public:
+	explicit BitReader(const std::string& s)
+		: m_words(s.size() / 64 + 2, 0)
+		, m_size(s.size())
+		, m_pos(0)
+	{
+		const char *p = s.data();
+		size_t i = 0;
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+		// gathers the low bits of 8 characters into one byte
+		for(; i + 8 <= m_size; i += 8){
+			uint64_t x;
+			std::memcpy(&x, p + i, sizeof(x));
+			const uint64_t byte = ((x & BYTE_LSB_MASK) * 0x8040201008040201ull) >> 56;
+			m_words[i / 64] |= byte << (56 - i % 64);
+		}
+#endif
+		for(; i < m_size; ++i){
+			m_words[i / 64] |= static_cast<uint64_t>(p[i] & 1) << (63 - i % 64);
+		}
+	}
+
+	size_t position() const { return m_pos; }
+	void seek(size_t pos){ m_pos = pos; }
+	size_t remaining() const { return m_size - m_pos; }
+
+	void require(size_t n) const {
+		if(remaining() < n){ throw std::runtime_error("demodulation error"); }
+	}
+
+	// n <= 64
+	uint64_t peek(size_t n) const {
+		return n == 0 ? 0 : word_at(m_pos) >> (64 - n);
+	}
+
+	uint64_t read(size_t n){
+		require(n);
+		const uint64_t v = peek(n);
+		m_pos += n;
+		return v;
+	}
+
+	void skip(size_t n){
+		require(n);
+		m_pos += n;
+	}
+
+	// Length of the run of ones starting at the current position
+	size_t count_ones() const {
+		size_t n = 0;
+		while(true){
+			const uint64_t x = ~word_at(m_pos + n);
+			if(x != 0){ return n + __builtin_clzl(x); }
+			n += 64;
+		}
+	}
+
+	long read_number(){
+		const bool negative = (read(2) >> 1) != 0;
+		const size_t width = count_ones();
+		if(width > 16){ throw std::runtime_error("demodulation error"); }
+		skip(width + 1);
+		const long v = static_cast<long>(read(width * 4));
+		return negative ? -v : v;
+	}
+
+};
+
+class BitWriter {
+
+private:
+	std::vector<uint64_t> m_words;
+	size_t m_size;
+
+public:
+	explicit BitWriter(size_t capacity)
+		: m_words(capacity / 64 + 2, 0)
+		, m_size(0)
+	{ }
+
+	// Appends the low n bits of v; n <= 64 and the buffer never grows
+	void write(uint64_t v, size_t n){
+		if(n == 0){ return; }
+		const size_t w = m_size / 64, o = m_size % 64;
+		v <<= 64 - n;
+		m_words[w] |= v >> o;
+		if(o + n > 64){ m_words[w + 1] |= v << (64 - o); }
+		m_size += n;
+	}
+
+	void write_ones(size_t n){
+		for(; n >= 64; n -= 64){ write(~0ull, 64); }
+		write((1ull << n) - 1, n);
+	}
+
+	std::string str() const {
+		std::string s(m_size, '0');
+		char *p = &s[0];
+		size_t i = 0;
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+		// spreads one byte into 8 characters
+		for(; i + 8 <= m_size; i += 8){
+			const uint64_t byte = (m_words[i / 64] >> (56 - i % 64)) & 0xff;
+			const uint64_t bits = (byte * BYTE_LSB_MASK) & 0x0102040810204080ull;
+			const uint64_t x = (((bits + 0x7f7f7f7f7f7f7f7full) >> 7) & BYTE_LSB_MASK) | 0x3030303030303030ull;
+			std::memcpy(p + i, &x, sizeof(x));
+		}
+#endif
+		for(; i < m_size; ++i){
+			p[i] = static_cast<char>('0' + ((m_words[i / 64] >> (63 - i % 64)) & 1));
+		}
+		return s;
+	}
+
+};
+
+inline size_t number_width(long x){
+	if(x == 0){ return 0; }
+	const unsigned long y = std::abs(x);
+	return (sizeof(y) * 8 - __builtin_clzl(y) + 3) & ~3;
+}
+
+inline size_t modulated_size(const Element& e){
+	if(e.is_number()){
+		return 3 + number_width(e.as_number()) * 5 / 4;
+	}else if(e.is_vector()){
+		const auto v = e.as_vector();
+		return 2 + modulated_size(Element(v.x)) + modulated_size(Element(v.y));
+	}else if(e.is_list()){
+		size_t n = 2;
+		for(const auto& c : e.as_list()){ n += 2 + modulated_size(c); }
+		return n;
+	}
+	return 2;
+}
+
+inline void modulate_number(BitWriter& w, long x){
+	const size_t b = number_width(x);
+	w.write(x < 0 ? 2 : 1, 2);
+	w.write_ones(b / 4);
+	w.write(0, 1);
+	w.write(std::abs(x), b);
+}
+
+inline void modulate_recur(BitWriter& w, const Element& e){
 	if(e.is_nil()){
-		os << "00";
+		w.write(0, 2);
 	}else if(e.is_number()){
-		const long x = e.as_number();
-		if(x == 0){
-			os << "010";
-		}else{
-			const long y = std::abs(x);
-			const long b = (sizeof(y) * 8 - __builtin_clzl(y) + 3) & ~3;
-			os << (x > 0 ? "01" : "10");
-			for(long i = 0; i < b; i += 4){ os << "1"; }
-			os << "0";
-			for(long i = b - 1; i >= 0; --i){ os << ((y >> i) & 1); }
-		}
+		modulate_number(w, e.as_number());
 	}else if(e.is_vector()){
-		const auto& v = e.as_vector();
-		os << "11";
-		modulate_recur(os, Element(v.x));
-		modulate_recur(os, Element(v.y));
+		const auto v = e.as_vector();
+		w.write(3, 2);
+		modulate_number(w, v.x);
+		modulate_number(w, v.y);
 	}else if(e.is_list()){
 		for(const auto& c : e.as_list()){
-			os << "11";
-			modulate_recur(os, c);
+			w.write(3, 2);
+			modulate_recur(w, c);
 		}
-		os << "00";
+		w.write(0, 2);
 	}
 }
 
 }
 
-static std::string modulate(const Element& e){
-	std::ostringstream oss;
-	detail::modulate_recur(oss, e);
-	return oss.str();
+inline std::string modulate(const Element& e){
+	detail::BitWriter w(detail::modulated_size(e));
+	detail::modulate_recur(w, e);
+	return w.str();
 }
 
 namespace detail {
 
-static Element demodulate_recur(std::istream& is){
-	const char m0 = is.get();
-	const char m1 = is.get();
-	if(m0 == '0' && m1 == '0'){
-		return Element();
-	}else if(m0 == '1' && m1 == '1'){
-		auto e0 = demodulate_recur(is);
-		auto e1 = demodulate_recur(is);
-		if(e1.is_nil()){
-			std::vector<Element> v = { e0 };
-			return Element(std::move(v));
-		}else if(e0.is_number() && e1.is_number()){
-			return Element(Vec(e0.as_number(), e1.as_number()));
-		}else if(e1.is_list()){
-			std::vector<Element> v = { e0 };
-			for(auto& e : e1.as_list()){ v.push_back(std::move(e)); }
-			return Element(v);
-		}else{
-			throw std::runtime_error("demodulation error");
+// Decodes a modulated signal into a single ElementBlock.
+// cons cells are counted first so that every list of the message can be
+// placed into one allocation; lists are built in linear time.
+class ElementDecoder {
+
+private:
+	static const uint64_t NIL  = 0;
+	static const uint64_t CONS = 3;
+
+	BitReader m_reader;
+	ElementBlock *m_block;
+	std::vector<Element> m_stack;  // children of the lists being decoded
+
+	size_t count_cells(){
+		const size_t start = m_reader.position();
+		size_t cells = 0;
+		while(m_reader.remaining() >= 2){
+			const uint64_t tag = m_reader.peek(2);
+			if(tag == CONS){
+				++cells;
+				m_reader.skip(2);
+			}else if(tag == NIL){
+				m_reader.skip(2);
+			}else{
+				m_reader.skip(2);
+				const size_t width = m_reader.count_ones();
+				if(m_reader.remaining() < width * 5 + 1){ break; }
+				m_reader.skip(width * 5 + 1);
+			}
+		}
+		m_reader.seek(start);
+		return cells;
+	}
+
+	Element decode(){
+		const uint64_t tag = m_reader.peek(2);
+		m_reader.require(2);
+		if(tag == NIL){
+			m_reader.skip(2);
+			return Element();
+		}else if(tag != CONS){
+			return Element(m_reader.read_number());
+		}
+		// (e0 . e1): a pair of numbers is a vector, otherwise a list
+		m_reader.skip(2);
+		const size_t first = m_stack.size();
+		m_stack.push_back(decode());
+		while(true){
+			m_reader.require(2);
+			const uint64_t next = m_reader.peek(2);
+			if(next == NIL){
+				m_reader.skip(2);
+				break;
+			}else if(next == CONS){
+				m_reader.skip(2);
+				m_stack.push_back(decode());
+			}else{
+				const long y = m_reader.read_number();
+				if(m_stack.size() != first + 1 || !m_stack[first].is_number()){
+					throw std::runtime_error("demodulation error");
+				}
+				const long x = m_stack[first].as_number();
+				m_stack.pop_back();
+				return Element(Vec(x, y));
+			}
+		}
+		const auto size = static_cast<uint32_t>(m_stack.size() - first);
+		Element *items = m_block->items() + m_block->size;
+		for(size_t i = first; i < m_stack.size(); ++i){
+			Element& c = m_stack[i];
+			Element *dst = m_block->items() + m_block->size;
+			if(c.m_kind == Element::ElementKind::LIST && c.m_list.block == m_block){
+				// must not keep its own block alive
+				new(dst) Element(m_block, c.m_list.items, c.m_size);
+			}else{
+				new(dst) Element(std::move(c));
+			}
+			++m_block->size;
+		}
+		m_stack.resize(first);
+		return Element(m_block, items, size);
+	}
+
+public:
+	explicit ElementDecoder(const std::string& s)
+		: m_reader(s)
+		, m_block(nullptr)
+		, m_stack()
+	{ }
+
+	Element operator()(){
+		const size_t cells = count_cells();
+		if(cells == 0){ return decode(); }
+		m_block = ElementBlock::allocate(cells);
+		ElementBlock::retain(m_block);
+		m_stack.reserve(cells);
+		try {
+			Element root = decode();
+			if(root.is_list() && root.m_list.block == m_block){
+				root.m_owner = true;  // takes over the reference held by the decoder
+			}else{
+				ElementBlock::release(m_block);
+			}
+			return root;
+		}catch(...){
+			m_stack.clear();
+			ElementBlock::release(m_block);
+			throw;
 		}
-	}else{
-		const long sign = (m0 == '0' ? 1 : -1);
-		long b = 0, v = 0;
-		while(is.get() == '1'){ b += 4; }
-		for(long i = 0; i < b; ++i){ v = (v << 1) | (is.get() - '0'); }
-		return Element(sign * v);
 	}
+
+};
+
 }
 
+inline Element demodulate(const std::string& s){
+	return detail::ElementDecoder(s)();
 }
 
-static Element demodulate(const std::string& s){
-	std::istringstream iss(s);
-	return detail::demodulate_recur(iss);
+namespace detail {
+
+struct SkipField { };
+
+template <typename... Ts>
+struct NestedFields {
+	std::tuple<Ts&...> fields;
+};
+
+}
+
+// Placeholders for declaring schemas with SignalParser::fields()
+static const detail::SkipField skip_field = detail::SkipField();
+
+template <typename... Ts>
+inline detail::NestedFields<Ts...> nested(Ts&... targets){
+	return detail::NestedFields<Ts...>{ std::tie(targets...) };
+}
+
+namespace detail {
+
+// Reads a modulated signal directly into structures declaring a schema:
+//   static T decode(SignalParser& p){ T x; p.fields(x.a, skip_field, nested(x.b, x.c)); return x; }
+// Values not covered by the schema are skipped without building elements and
+// values of an unexpected shape leave the corresponding field untouched.
+class SignalParser {
+
+private:
+	static const uint64_t NIL  = 0;
+	static const uint64_t CONS = 3;
+
+	BitReader m_reader;
+
+	uint64_t tag() const {
+		m_reader.require(2);
+		return m_reader.peek(2);
+	}
+
+	bool is_number() const {
+		const uint64_t t = tag();
+		return t != NIL && t != CONS;
+	}
+
+	// Advances to the next item of a list; false at the end of the list
+	bool next_item(){
+		const uint64_t t = tag();
+		if(t == CONS){
+			m_reader.skip(2);
+			return true;
+		}else if(t != NIL){
+			m_reader.read_number();  // improper tail
+			return false;
+		}
+		m_reader.skip(2);
+		return false;
+	}
+
+	void skip_value(){
+		size_t pending = 1;
+		while(pending > 0){
+			const uint64_t t = tag();
+			if(t == CONS){
+				m_reader.skip(2);
+				++pending;
+			}else if(t == NIL){
+				m_reader.skip(2);
+				--pending;
+			}else{
+				m_reader.read_number();
+				--pending;
+			}
+		}
+	}
+
+	void read(long& x){
+		if(is_number()){
+			x = m_reader.read_number();
+		}else{
+			skip_value();
+		}
+	}
+
+	void read(Vec& v){
+		const size_t start = m_reader.position();
+		if(tag() == CONS){
+			m_reader.skip(2);
+			if(is_number()){
+				const long x = m_reader.read_number();
+				if(is_number()){
+					v = Vec(x, m_reader.read_number());
+					return;
+				}
+			}
+		}
+		m_reader.seek(start);
+		skip_value();
+	}
+
+	template <typename T>
+	typename std::enable_if<std::is_enum<T>::value>::type read(T& x){
+		long v = static_cast<long>(x);
+		read(v);
+		x = static_cast<T>(v);
+	}
+
+	template <typename T>
+	auto read(T& x) -> decltype(x = T::decode(*this), void()){
+		x = T::decode(*this);
+	}
+
+	template <typename T>
+	void read(std::vector<T>& v){
+		v.clear();
+		if(is_number()){
+			skip_value();
+			return;
+		}
+		while(next_item()){
+			v.emplace_back();
+			read(v.back());
+		}
+	}
+
+	void read(const SkipField&){
+		skip_value();
+	}
+
+	template <typename... Ts, size_t... I>
+	void read_nested(std::tuple<Ts&...>& t, std::index_sequence<I...>){
+		fields(std::get<I>(t)...);
+	}
+
+	template <typename... Ts>
+	void read(NestedFields<Ts...>& f){
+		read_nested(f.fields, std::index_sequence_for<Ts...>());
+	}
+
+	template <typename T>
+	void read_item(bool& open, T&& x){
+		if(!open){ return; }
+		open = next_item();
+		if(open){ read(x); }
+	}
+
+public:
+	explicit SignalParser(const std::string& s)
+		: m_reader(s)
+	{ }
+
+	// Reads a list whose items are assigned to `targets` in order.
+	// Missing items leave targets untouched and extra items are skipped.
+	template <typename... Ts>
+	void fields(Ts&&... targets){
+		if(is_number()){
+			skip_value();
+			return;
+		}
+		bool open = true;
+		using expand = int[];
+		(void)expand{ 0, (read_item(open, targets), 0)... };
+		if(open){
+			while(next_item()){ skip_value(); }
+		}
+	}
+
+};
+
+}
+
+// Decodes a modulated signal straight into T, which must provide
+// `static T decode(detail::SignalParser&)`.
+template <typename T>
+inline T demodulate_as(const std::string& s){
+	detail::SignalParser p(s);
+	return T::decode(p);
 }
 
 
 //----------------------------------------------------------------------------
 // Networking
 //----------------------------------------------------------------------------
+// Seconds since the start of a transfer, as reported by libcurl
+struct HttpTiming {
+	double connect;     // 0 on a reused connection
+	double first_byte;
+	double total;
+
+	HttpTiming()
+		: connect(0.0)
+		, first_byte(0.0)
+		, total(0.0)
+	{ }
+};
+
+namespace detail {
+
+inline void read_http_timing(CURL *handle, HttpTiming *timing){
+	if(!timing){ return; }
+	curl_easy_getinfo(handle, CURLINFO_CONNECT_TIME, &timing->connect);
+	curl_easy_getinfo(handle, CURLINFO_STARTTRANSFER_TIME, &timing->first_byte);
+	curl_easy_getinfo(handle, CURLINFO_TOTAL_TIME, &timing->total);
+}
+
+}
+
 class RemoteQueryEngine {
 
 private:
@@ -293,17 +953,338 @@ public:
 		curl_easy_setopt(m_curl.get(), CURLOPT_WRITEFUNCTION, callback);
 	}
 
-	std::string operator()(const std::string& body){
+	std::string operator()(const std::string& body, HttpTiming *timing = nullptr){
 		std::vector<char> received_raw;
 		curl_easy_setopt(m_curl.get(), CURLOPT_POSTFIELDS, body.c_str());
 		curl_easy_setopt(m_curl.get(), CURLOPT_WRITEDATA, &received_raw);
 		curl_easy_perform(m_curl.get());
+		detail::read_http_timing(m_curl.get(), timing);
 		received_raw.push_back('\0');
 		return std::string(received_raw.data());
 	}
 
 };
 
+// Multiplexes queries from many sessions over a pool of persistent
+// connections. A worker thread drives the curl multi interface and every
+// query completes through a future.
+class AsyncQueryEngine {
+
+private:
+	struct Request {
+		std::string body;
+		std::string response;
+		HttpTiming *timing;
+		std::promise<std::string> promise;
+	};
+
+	std::string m_endpoint;
+	std::unique_ptr<CURLM, decltype(&curl_multi_cleanup)> m_multi;
+	std::vector<std::unique_ptr<CURL, decltype(&curl_easy_cleanup)>> m_handles;
+
+	std::vector<CURL*> m_idle;  // touched by the worker only
+
+	std::mutex m_mutex;
+	std::deque<std::unique_ptr<Request>> m_pending;
+	bool m_stopping;
+
+	std::thread m_worker;
+
+	static size_t callback(char *buffer, size_t size, size_t nmemb, void *userdata){
+		reinterpret_cast<std::string*>(userdata)->append(buffer, size * nmemb);
+		return size * nmemb;
+	}
+
+	void start(CURL *handle, std::unique_ptr<Request> request){
+		curl_easy_setopt(handle, CURLOPT_POSTFIELDS, request->body.c_str());
+		curl_easy_setopt(handle, CURLOPT_POSTFIELDSIZE, static_cast<long>(request->body.size()));
+		curl_easy_setopt(handle, CURLOPT_WRITEDATA, &request->response);
+		curl_easy_setopt(handle, CURLOPT_PRIVATE, request.release());
+		curl_multi_add_handle(m_multi.get(), handle);
+	}
+
+	void finish(CURL *handle, CURLcode result){
+		char *p = nullptr;
+		curl_easy_getinfo(handle, CURLINFO_PRIVATE, &p);
+		std::unique_ptr<Request> request(reinterpret_cast<Request*>(p));
+		detail::read_http_timing(handle, request->timing);
+		curl_multi_remove_handle(m_multi.get(), handle);
+		m_idle.push_back(handle);
+		if(result == CURLE_OK){
+			request->promise.set_value(std::move(request->response));
+		}else{
+			request->promise.set_exception(std::make_exception_ptr(
+				std::runtime_error(curl_easy_strerror(result))));
+		}
+	}
+
+	// Moves pending requests onto idle connections; false once stopped and drained
+	bool dispatch(bool& has_work){
+		std::lock_guard<std::mutex> lock(m_mutex);
+		while(!m_idle.empty() && !m_pending.empty()){
+			start(m_idle.back(), std::move(m_pending.front()));
+			m_idle.pop_back();
+			m_pending.pop_front();
+		}
+		has_work = !m_pending.empty() || m_idle.size() < m_handles.size();
+		return has_work || !m_stopping;
+	}
+
+	void run(){
+		bool has_work = false;
+		while(dispatch(has_work)){
+			int running = 0;
+			curl_multi_perform(m_multi.get(), &running);
+			int queued = 0;
+			bool completed = false;
+			while(CURLMsg *msg = curl_multi_info_read(m_multi.get(), &queued)){
+				if(msg->msg != CURLMSG_DONE){ continue; }
+				finish(msg->easy_handle, msg->data.result);
+				completed = true;
+			}
+			if(!completed){
+				curl_multi_poll(m_multi.get(), nullptr, 0, 1000, nullptr);
+			}
+		}
+	}
+
+public:
+	explicit AsyncQueryEngine(std::string endpoint, size_t connections = 16)
+		: m_endpoint(std::move(endpoint))
+		, m_multi(curl_multi_init(), &curl_multi_cleanup)
+		, m_handles()
+		, m_idle()
+		, m_mutex()
+		, m_pending()
+		, m_stopping(false)
+		, m_worker()
+	{
+		if(!m_multi){ throw std::runtime_error("failed to initialize libcurl"); }
+		curl_multi_setopt(m_multi.get(), CURLMOPT_MAX_HOST_CONNECTIONS, static_cast<long>(connections));
+		for(size_t i = 0; i < connections; ++i){
+			m_handles.emplace_back(curl_easy_init(), &curl_easy_cleanup);
+			CURL *handle = m_handles.back().get();
+			if(!handle){ throw std::runtime_error("failed to initialize libcurl"); }
+			curl_easy_setopt(handle, CURLOPT_URL, m_endpoint.c_str());
+			curl_easy_setopt(handle, CURLOPT_WRITEFUNCTION, callback);
+			curl_easy_setopt(handle, CURLOPT_TCP_KEEPALIVE, 1L);
+			m_idle.push_back(handle);
+		}
+		m_worker = std::thread([this](){ run(); });
+	}
+
+	AsyncQueryEngine(const AsyncQueryEngine&) = delete;
+	AsyncQueryEngine& operator=(const AsyncQueryEngine&) = delete;
+
+	// Completes queries that are already posted before returning
+	~AsyncQueryEngine(){
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_stopping = true;
+		}
+		curl_multi_wakeup(m_multi.get());
+		m_worker.join();
+	}
+
+	// `timing` is filled before the future becomes ready
+	std::future<std::string> post(std::string body, HttpTiming *timing = nullptr){
+		std::unique_ptr<Request> request(new Request());
+		request->body   = std::move(body);
+		request->timing = timing;
+		auto future = request->promise.get_future();
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_pending.push_back(std::move(request));
+		}
+		curl_multi_wakeup(m_multi.get());
+		return future;
+	}
+
+};
+
+// Transport used by GalaxyContext: sends a modulated query and fills the
+// optional timing once the response is available.
+using QueryFunction = std::function<std::future<std::string>(const std::string&, HttpTiming*)>;
+
+
+//----------------------------------------------------------------------------
+// Traffic recording
+//----------------------------------------------------------------------------
+// Log format: "GXTR", a version byte, then (request, response) pairs.
+// Each signal is a varint of (length << 1 | raw) followed by the signal
+// packed 8 characters per byte, or by the raw bytes when it is not binary.
+namespace detail {
+
+static const char TRAFFIC_MAGIC[4] = { 'G', 'X', 'T', 'R' };
+static const char TRAFFIC_VERSION  = 1;
+
+inline void write_varint(std::ostream& os, uint64_t x){
+	while(x >= 0x80){
+		os.put(static_cast<char>((x & 0x7f) | 0x80));
+		x >>= 7;
+	}
+	os.put(static_cast<char>(x));
+}
+
+inline bool read_varint(std::istream& is, uint64_t& x){
+	x = 0;
+	for(int shift = 0; shift < 64; shift += 7){
+		const int c = is.get();
+		if(c == EOF){ return false; }
+		x |= static_cast<uint64_t>(c & 0x7f) << shift;
+		if(!(c & 0x80)){ return true; }
+	}
+	return false;
+}
+
+inline void write_signal(std::ostream& os, const std::string& s){
+	const bool raw = (s.find_first_not_of("01") != std::string::npos);
+	write_varint(os, (static_cast<uint64_t>(s.size()) << 1) | raw);
+	if(raw){
+		os.write(s.data(), s.size());
+		return;
+	}
+	std::string packed((s.size() + 7) / 8, '\0');
+	for(size_t i = 0; i < s.size(); ++i){
+		packed[i / 8] |= static_cast<char>((s[i] & 1) << (7 - i % 8));
+	}
+	os.write(packed.data(), packed.size());
+}
+
+inline bool read_signal(std::istream& is, std::string& s){
+	uint64_t header = 0;
+	if(!read_varint(is, header)){ return false; }
+	const size_t size = header >> 1;
+	if(header & 1){
+		s.resize(size);
+		return static_cast<bool>(is.read(&s[0], size));
+	}
+	std::string packed((size + 7) / 8, '\0');
+	if(!is.read(&packed[0], packed.size())){ return false; }
+	s.resize(size);
+	for(size_t i = 0; i < size; ++i){
+		s[i] = static_cast<char>('0' + ((packed[i / 8] >> (7 - i % 8)) & 1));
+	}
+	return true;
+}
+
+}
+
+// Appends every request/response pair that goes through wrap() to a log.
+// Pairs are written when the response is consumed.
+class TrafficRecorder {
+
+private:
+	std::mutex m_mutex;
+	std::ofstream m_stream;
+
+public:
+	explicit TrafficRecorder(const std::string& path)
+		: m_mutex()
+		, m_stream(path, std::ios::binary | std::ios::app)
+	{
+		if(!m_stream){ throw std::runtime_error("failed to open " + path); }
+		if(m_stream.tellp() == 0){
+			m_stream.write(detail::TRAFFIC_MAGIC, sizeof(detail::TRAFFIC_MAGIC));
+			m_stream.put(detail::TRAFFIC_VERSION);
+		}
+	}
+
+	void append(const std::string& request, const std::string& response){
+		std::lock_guard<std::mutex> lock(m_mutex);
+		detail::write_signal(m_stream, request);
+		detail::write_signal(m_stream, response);
+		m_stream.flush();
+	}
+
+	static QueryFunction wrap(std::shared_ptr<TrafficRecorder> recorder, QueryFunction query){
+		return [recorder, query](const std::string& body, HttpTiming *timing){
+			auto res = query(body, timing);
+			return std::async(std::launch::deferred, [recorder, body](std::future<std::string> res){
+				auto response = res.get();
+				recorder->append(body, response);
+				return response;
+			}, std::move(res));
+		};
+	}
+
+};
+
+// Serves recorded responses without any network access, either in
+// recording order or by looking up the request.
+class ReplayTransport {
+
+public:
+	enum class Mode {
+		ORDERED,
+		KEYED,
+	};
+
+private:
+	struct State {
+		std::mutex mutex;
+		std::vector<std::pair<std::string, std::string>> records;
+		size_t cursor;
+		std::unordered_map<std::string, std::deque<size_t>> by_request;
+	};
+
+	Mode m_mode;
+	std::shared_ptr<State> m_state;
+
+public:
+	explicit ReplayTransport(const std::string& path, Mode mode = Mode::ORDERED)
+		: m_mode(mode)
+		, m_state(std::make_shared<State>())
+	{
+		std::ifstream ifs(path, std::ios::binary);
+		char magic[sizeof(detail::TRAFFIC_MAGIC)] = { 0 };
+		ifs.read(magic, sizeof(magic));
+		if(!ifs || !std::equal(magic, magic + sizeof(magic), detail::TRAFFIC_MAGIC) ||
+		   ifs.get() != detail::TRAFFIC_VERSION)
+		{
+			throw std::runtime_error("not a traffic log: " + path);
+		}
+		std::string request, response;
+		while(detail::read_signal(ifs, request) && detail::read_signal(ifs, response)){
+			m_state->by_request[request].push_back(m_state->records.size());
+			m_state->records.emplace_back(std::move(request), std::move(response));
+		}
+		m_state->cursor = 0;
+	}
+
+	size_t size() const { return m_state->records.size(); }
+
+	const std::pair<std::string, std::string>& operator[](size_t i) const {
+		return m_state->records[i];
+	}
+
+	std::future<std::string> operator()(const std::string& body, HttpTiming *timing = nullptr){
+		std::promise<std::string> promise;
+		std::lock_guard<std::mutex> lock(m_state->mutex);
+		size_t index = 0;
+		if(m_mode == Mode::ORDERED){
+			index = m_state->cursor++;
+		}else{
+			auto it = m_state->by_request.find(body);
+			if(it != m_state->by_request.end() && !it->second.empty()){
+				index = it->second.front();
+				it->second.pop_front();
+			}else{
+				index = m_state->records.size();
+			}
+		}
+		if(index >= m_state->records.size()){
+			promise.set_exception(std::make_exception_ptr(
+				std::runtime_error("replay: no recorded response for " + body)));
+		}else{
+			if(timing){ *timing = HttpTiming(); }
+			promise.set_value(m_state->records[index].second);
+		}
+		return promise.get_future();
+	}
+
+};
+
 
 //----------------------------------------------------------------------------
 // Structures
@@ -313,7 +1294,7 @@ enum class PlayerRole {
 	DEFENDER = 1
 };
 
-std::ostream& operator<<(std::ostream& os, PlayerRole x){
+inline std::ostream& operator<<(std::ostream& os, PlayerRole x){
 	switch(x){
 	case PlayerRole::ATTACKER: return os << "Attacker";
 	case PlayerRole::DEFENDER: return os << "Defender";
@@ -327,7 +1308,7 @@ enum class GameStage {
 	COMPLETED   = 2
 };
 
-std::ostream& operator<<(std::ostream& os, GameStage x){
+inline std::ostream& operator<<(std::ostream& os, GameStage x){
 	switch(x){
 	case GameStage::NOT_STARTED: return os << "NotStarted";
 	case GameStage::RUNNING:     return os << "Running";
@@ -354,12 +1335,7 @@ struct ShipParams {
 	ShipParams() : x0(0), x1(0), x2(0), x3(0) { }
 
 	Element encode() const {
-		std::vector<Element> root;
-		root.emplace_back(x0);
-		root.emplace_back(x1);
-		root.emplace_back(x2);
-		root.emplace_back(x3);
-		return Element(std::move(root));
+		return Element{ x0, x1, x2, x3 };
 	}
 
 	static ShipParams decode(const Element& e){
@@ -373,6 +1349,12 @@ struct ShipParams {
 		return params;
 	}
 
+	static ShipParams decode(detail::SignalParser& p){
+		ShipParams params;
+		p.fields(params.x0, params.x1, params.x2, params.x3);
+		return params;
+	}
+
 	void dump(std::ostream& os, size_t depth = 0) const {
 		const std::string prefix(depth * 2, ' ');
 		os << prefix << "x0: " << x0 << std::endl;
@@ -398,35 +1380,19 @@ public:
 	}
 
 	void accel(long ship_id, const Vec& v){
-		std::vector<Element> root;
-		root.emplace_back(0);
-		root.emplace_back(ship_id);
-		root.emplace_back(v);
-		m_commands.push_back(std::move(root));
+		m_commands.push_back(Element{ 0, ship_id, v });
 	}
 
 	void detonate(long ship_id){
-		std::vector<Element> root;
-		root.emplace_back(1);
-		root.emplace_back(ship_id);
-		m_commands.push_back(std::move(root));
+		m_commands.push_back(Element{ 1, ship_id });
 	}
 
 	void shoot(long ship_id, const Vec& target, long power){
-		std::vector<Element> root;
-		root.emplace_back(2);
-		root.emplace_back(ship_id);
-		root.emplace_back(target);
-		root.emplace_back(power);
-		m_commands.push_back(std::move(root));
+		m_commands.push_back(Element{ 2, ship_id, target, power });
 	}
 
 	void fork(long ship_id, const ShipParams& new_params){
-		std::vector<Element> root;
-		root.emplace_back(3);
-		root.emplace_back(ship_id);
-		root.emplace_back(new_params.encode());
-		m_commands.push_back(std::move(root));
+		m_commands.push_back(Element{ 3, ship_id, new_params.encode() });
 	}
 
 };
@@ -459,6 +1425,16 @@ struct StaticGameInfo {
 		return info;
 	}
 
+	static StaticGameInfo decode(detail::SignalParser& p){
+		StaticGameInfo info;
+		p.fields(
+			info.time_limit,
+			info.self_role,
+			nested(info.parameter_capacity),
+			nested(info.galaxy_radius, info.universe_radius));
+		return info;
+	}
+
 	void dump(std::ostream& os, size_t depth = 0) const {
 		const std::string prefix(depth * 2, ' ');
 		os << prefix << "time_limit: " << time_limit << std::endl;
@@ -505,6 +1481,14 @@ struct ShipState {
 		return state;
 	}
 
+	static ShipState decode(detail::SignalParser& p){
+		ShipState state;
+		p.fields(
+			state.role, state.id, state.pos, state.vel, state.params,
+			state.x5, state.x6, state.x7);
+		return state;
+	}
+
 	void dump(std::ostream& os, size_t depth = 0) const {
 		const std::string prefix(depth * 2, ' ');
 		os << prefix << "role: " << role << std::endl;
@@ -535,6 +1519,12 @@ struct ShipAndCommands {
 		return sac;
 	}
 
+	static ShipAndCommands decode(detail::SignalParser& p){
+		ShipAndCommands sac;
+		p.fields(sac.ship);
+		return sac;
+	}
+
 	void dump(std::ostream& os, size_t depth = 0) const {
 		const std::string prefix(depth * 2, ' ');
 		os << prefix << "ship:" << std::endl;
@@ -563,6 +1553,12 @@ struct GameState {
 		return state;
 	}
 
+	static GameState decode(detail::SignalParser& p){
+		GameState state;
+		p.fields(state.elapsed, skip_field, state.ships);
+		return state;
+	}
+
 	void dump(std::ostream& os, size_t depth = 0) const {
 		const std::string prefix(depth * 2, ' ');
 		os << prefix << "elapsed: " << elapsed << std::endl;
@@ -594,6 +1590,12 @@ struct GameResponse {
 		return res;
 	}
 
+	static GameResponse decode(detail::SignalParser& p){
+		GameResponse res;
+		p.fields(skip_field, res.stage, res.static_info, res.state);
+		return res;
+	}
+
 	void dump(std::ostream& os, size_t depth = 0) const {
 		const std::string prefix(depth * 2, ' ');
 		os << prefix << "stage: " << stage << std::endl;
@@ -605,6 +1607,172 @@ struct GameResponse {
 };
 
 
+//----------------------------------------------------------------------------
+// Instrumentation
+//----------------------------------------------------------------------------
+enum class QueryPhase {
+	ENCODE,      // building the query element
+	MODULATE,
+	CONNECT,     // HTTP connection setup
+	FIRST_BYTE,  // from connection to the first byte of the response
+	TRANSFER,    // from the first byte to the end of the response
+	DECODE,      // demodulating into the response structure; the parser is
+	             // lazy, so demodulation cannot be timed on its own
+	TOTAL,       // from encoding to the decoded response
+	NUM_PHASES
+};
+
+inline std::ostream& operator<<(std::ostream& os, QueryPhase x){
+	static const char *names[] = {
+		"encode", "modulate", "connect", "first_byte",
+		"transfer", "decode", "total"
+	};
+	return os << names[static_cast<int>(x)];
+}
+
+namespace detail {
+
+inline uint64_t now_ns(){
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+}
+
+// Histogram of durations in power-of-two nanosecond buckets.
+// Written by a single thread without read-modify-write operations;
+// other threads may read it at any time.
+class LatencyHistogram {
+
+public:
+	static const size_t NUM_BUCKETS = 64;
+
+private:
+	std::array<std::atomic<uint64_t>, NUM_BUCKETS> m_buckets;  // [2^(i-1), 2^i) ns
+	std::atomic<uint64_t> m_count;
+	std::atomic<uint64_t> m_sum;
+	std::atomic<uint64_t> m_max;
+
+	static void add(std::atomic<uint64_t>& x, uint64_t v){
+		x.store(x.load(std::memory_order_relaxed) + v, std::memory_order_relaxed);
+	}
+
+public:
+	LatencyHistogram()
+		: m_count(0)
+		, m_sum(0)
+		, m_max(0)
+	{
+		for(auto& b : m_buckets){ b.store(0, std::memory_order_relaxed); }
+	}
+
+	// Snapshot of `other`; same single-writer rule as merge()
+	LatencyHistogram(const LatencyHistogram& other)
+		: LatencyHistogram()
+	{
+		merge(other);
+	}
+	LatencyHistogram& operator=(const LatencyHistogram&) = delete;
+
+	void record(uint64_t ns){
+		const size_t i = (ns == 0 ? 0 : 64 - __builtin_clzll(ns));
+		add(m_buckets[std::min(i, NUM_BUCKETS - 1)], 1);
+		add(m_count, 1);
+		add(m_sum, ns);
+		if(ns > m_max.load(std::memory_order_relaxed)){
+			m_max.store(ns, std::memory_order_relaxed);
+		}
+	}
+
+	// Adds the samples of another histogram; same single-writer rule as record()
+	void merge(const LatencyHistogram& other){
+		for(size_t i = 0; i < NUM_BUCKETS; ++i){
+			add(m_buckets[i], other.m_buckets[i].load(std::memory_order_relaxed));
+		}
+		add(m_count, other.count());
+		add(m_sum, other.sum());
+		if(other.max() > m_max.load(std::memory_order_relaxed)){
+			m_max.store(other.max(), std::memory_order_relaxed);
+		}
+	}
+
+	uint64_t count() const { return m_count.load(std::memory_order_relaxed); }
+	uint64_t sum() const { return m_sum.load(std::memory_order_relaxed); }
+	uint64_t max() const { return m_max.load(std::memory_order_relaxed); }
+
+	double mean() const {
+		const uint64_t n = count();
+		return n == 0 ? 0.0 : static_cast<double>(sum()) / n;
+	}
+
+	// Upper bound of the bucket containing the q-quantile
+	uint64_t percentile(double q) const {
+		const uint64_t n = count();
+		if(n == 0){ return 0; }
+		const uint64_t rank = static_cast<uint64_t>(q * (n - 1)) + 1;
+		uint64_t acc = 0;
+		for(size_t i = 0; i < NUM_BUCKETS; ++i){
+			acc += m_buckets[i].load(std::memory_order_relaxed);
+			if(acc >= rank){ return std::min(i == 0 ? 0 : (uint64_t(1) << i) - 1, max()); }
+		}
+		return max();
+	}
+
+};
+
+// Per-session breakdown of query latency and traffic
+class QueryStats {
+
+private:
+	std::array<LatencyHistogram, static_cast<size_t>(QueryPhase::NUM_PHASES)> m_phases;
+	std::atomic<uint64_t> m_bytes_sent;
+	std::atomic<uint64_t> m_bytes_received;
+	const uint64_t m_created_at;
+
+public:
+	QueryStats()
+		: m_phases()
+		, m_bytes_sent(0)
+		, m_bytes_received(0)
+		, m_created_at(detail::now_ns())
+	{ }
+
+	void record(QueryPhase phase, uint64_t ns){
+		m_phases[static_cast<size_t>(phase)].record(ns);
+	}
+
+	void record_traffic(size_t sent, size_t received){
+		m_bytes_sent.store(bytes_sent() + sent, std::memory_order_relaxed);
+		m_bytes_received.store(bytes_received() + received, std::memory_order_relaxed);
+	}
+
+	const LatencyHistogram& operator[](QueryPhase phase) const {
+		return m_phases[static_cast<size_t>(phase)];
+	}
+
+	uint64_t queries() const { return (*this)[QueryPhase::TOTAL].count(); }
+	uint64_t bytes_sent() const { return m_bytes_sent.load(std::memory_order_relaxed); }
+	uint64_t bytes_received() const { return m_bytes_received.load(std::memory_order_relaxed); }
+
+	void dump(std::ostream& os, size_t depth = 0) const {
+		const std::string prefix(depth * 2, ' ');
+		const double elapsed = (detail::now_ns() - m_created_at) * 1e-9;
+		os << prefix << "queries: " << queries() << " (" << queries() / elapsed << " /s)" << std::endl;
+		os << prefix << "bytes: " << bytes_sent() << " sent, " << bytes_received() << " received" << std::endl;
+		os << prefix << "phase [us]: count mean p50 p90 p99 max" << std::endl;
+		for(size_t i = 0; i < m_phases.size(); ++i){
+			const auto& h = m_phases[i];
+			if(h.count() == 0){ continue; }
+			os << prefix << "  " << static_cast<QueryPhase>(i) << ": " << h.count() << " "
+			   << h.mean() * 1e-3 << " " << h.percentile(0.5) * 1e-3 << " "
+			   << h.percentile(0.9) * 1e-3 << " " << h.percentile(0.99) * 1e-3 << " "
+			   << h.max() * 1e-3 << std::endl;
+		}
+	}
+
+};
+
+
 //----------------------------------------------------------------------------
 // Context
 //----------------------------------------------------------------------------
@@ -613,56 +1781,122 @@ class GalaxyContext {
 private:
 	const long m_player_key;
 
-	RemoteQueryEngine m_remote;
+	QueryFunction m_query;
+	std::shared_ptr<QueryStats> m_stats;
+	std::shared_ptr<std::atomic<uint64_t>> m_received_at;
 
 	Element construct_create_room_query() const {
-		std::vector<Element> root;
-		root.emplace_back(1);
-		root.emplace_back(0);
-		return Element(std::move(root));
+		return Element{ 1, 0 };
 	}
 
 	Element construct_join_query() const {
-		std::vector<Element> root;
-		root.emplace_back(2);
-		root.emplace_back(m_player_key);
-		root.emplace_back();
-		return Element(std::move(root));
+		return Element{ 2, m_player_key, Element() };
 	}
 
 	Element construct_start_query(const ShipParams& params) const {
-		std::vector<Element> root;
-		root.emplace_back(3);
-		root.emplace_back(m_player_key);
-		root.emplace_back(params.encode());
-		return Element(std::move(root));
+		return Element{ 3, m_player_key, params.encode() };
 	}
 
 	Element construct_command_query(Element e) const {
-		std::vector<Element> root;
-		root.emplace_back(4);
-		root.emplace_back(m_player_key);
-		root.emplace_back(std::move(e));
-		return Element(std::move(root));
+		return Element{ 4, m_player_key, std::move(e) };
+	}
+
+	// `begin` is the time at which encoding of `q` started
+	std::future<GameResponse> query_game(const Element& q, uint64_t begin){
+		auto stats = m_stats;
+		auto received_at = m_received_at;
+		const uint64_t encoded = detail::now_ns();
+		stats->record(QueryPhase::ENCODE, encoded - begin);
+#ifdef GALAXY_VERBOSE
+		std::cerr << "<< " << serialize(q) << std::endl;
+#endif
+		auto body = modulate(q);
+		stats->record(QueryPhase::MODULATE, detail::now_ns() - encoded);
+		const size_t sent = body.size();
+		auto timing = std::make_shared<HttpTiming>();
+		auto res = m_query(std::move(body), timing.get());
+		return std::async(std::launch::deferred, [stats, received_at, timing, sent, begin](std::future<std::string> res){
+			const auto signal = res.get();
+			const uint64_t received = detail::now_ns();
+			received_at->store(received);
+			stats->record(QueryPhase::CONNECT, static_cast<uint64_t>(timing->connect * 1e9));
+			stats->record(QueryPhase::FIRST_BYTE, static_cast<uint64_t>((timing->first_byte - timing->connect) * 1e9));
+			stats->record(QueryPhase::TRANSFER, static_cast<uint64_t>((timing->total - timing->first_byte) * 1e9));
+			stats->record_traffic(sent, signal.size());
+#ifdef GALAXY_VERBOSE
+			std::cerr << ">> " << serialize(demodulate(signal)) << std::endl;
+#endif
+			detail::SignalParser parser(signal);
+			auto response = GameResponse::decode(parser);
+			const uint64_t decoded = detail::now_ns();
+			stats->record(QueryPhase::DECODE, decoded - received);
+			stats->record(QueryPhase::TOTAL, decoded - begin);
+			return response;
+		}, std::move(res));
+	}
+
+	static QueryFunction blocking_query(std::string endpoint){
+		auto remote = std::make_shared<RemoteQueryEngine>(std::move(endpoint));
+		return [remote](const std::string& body, HttpTiming *timing){
+			std::promise<std::string> promise;
+			try {
+				promise.set_value((*remote)(body, timing));
+			}catch(...){
+				promise.set_exception(std::current_exception());
+			}
+			return promise.get_future();
+		};
 	}
 
 public:
 	GalaxyContext()
 		: m_player_key(0)
-		, m_remote()
+		, m_query()
+		, m_stats(std::make_shared<QueryStats>())
+		, m_received_at(std::make_shared<std::atomic<uint64_t>>(0))
 	{ }
 
 	GalaxyContext(std::string endpoint, long player_key)
 		: m_player_key(player_key)
-		, m_remote(std::move(endpoint))
+		, m_query(blocking_query(std::move(endpoint)))
+		, m_stats(std::make_shared<QueryStats>())
+		, m_received_at(std::make_shared<std::atomic<uint64_t>>(0))
 	{ }
 
+	// Shares the connections of `engine` with other sessions
+	GalaxyContext(AsyncQueryEngine& engine, long player_key)
+		: m_player_key(player_key)
+		, m_query([&engine](const std::string& body, HttpTiming *timing){ return engine.post(body, timing); })
+		, m_stats(std::make_shared<QueryStats>())
+		, m_received_at(std::make_shared<std::atomic<uint64_t>>(0))
+	{ }
+
+	// Sends queries through an arbitrary transport such as ReplayTransport
+	GalaxyContext(QueryFunction query, long player_key)
+		: m_player_key(player_key)
+		, m_query(std::move(query))
+		, m_stats(std::make_shared<QueryStats>())
+		, m_received_at(std::make_shared<std::atomic<uint64_t>>(0))
+	{ }
+
+	// Appends all further traffic of this session to `recorder`
+	void record(std::shared_ptr<TrafficRecorder> recorder){
+		m_query = TrafficRecorder::wrap(std::move(recorder), std::move(m_query));
+	}
+
+	// Timing of join/start/command queries of this session
+	const QueryStats& stats() const { return *m_stats; }
+
+	// When the latest join/start/command response was received, in
+	// detail::now_ns() time; 0 before the first one
+	uint64_t received_at() const { return m_received_at->load(); }
+
 	RoomInfo create_room(){
 		const auto q = construct_create_room_query();
 #ifdef GALAXY_VERBOSE
 		std::cerr << "<< " << serialize(q) << std::endl;
 #endif
-		const auto res = demodulate(m_remote(modulate(q)));
+		const auto res = demodulate(m_query(modulate(q), nullptr).get());
 #ifdef GALAXY_VERBOSE
 		std::cerr << ">> " << serialize(res) << std::endl;
 #endif
@@ -678,42 +1912,27 @@ public:
 		return ri;
 	}
 
-	GameResponse join(){
-		const auto q = construct_join_query();
-#ifdef GALAXY_VERBOSE
-		std::cerr << "<< " << serialize(q) << std::endl;
-#endif
-		const auto res = demodulate(m_remote(modulate(q)));
-#ifdef GALAXY_VERBOSE
-		std::cerr << ">> " << serialize(res) << std::endl;
-#endif
-		return GameResponse::decode(res);
+	std::future<GameResponse> join_async(){
+		const uint64_t begin = detail::now_ns();
+		return query_game(construct_join_query(), begin);
 	}
 
-	GameResponse start(const ShipParams& params){
-		const auto q = construct_start_query(params);
-#ifdef GALAXY_VERBOSE
-		std::cerr << "<< "  << serialize(q) << std::endl;
-#endif
-		const auto res = demodulate(m_remote(modulate(q)));
-#ifdef GALAXY_VERBOSE
-		std::cerr << ">> " << serialize(res) << std::endl;
-#endif
-		return GameResponse::decode(res);
+	std::future<GameResponse> start_async(const ShipParams& params){
+		const uint64_t begin = detail::now_ns();
+		return query_game(construct_start_query(params), begin);
 	}
 
-	GameResponse command(const CommandListBuilder& cl){
-		const auto q = construct_command_query(cl.build());
-#ifdef GALAXY_VERBOSE
-		std::cerr << "<< "  << serialize(q) << std::endl;
-#endif
-		const auto res = demodulate(m_remote(modulate(q)));
-#ifdef GALAXY_VERBOSE
-		std::cerr << ">> " << serialize(res) << std::endl;
-#endif
-		return GameResponse::decode(res);
+	std::future<GameResponse> command_async(const CommandListBuilder& cl){
+		const uint64_t begin = detail::now_ns();
+		return query_game(construct_command_query(cl.build()), begin);
 	}
 
+	GameResponse join(){ return join_async().get(); }
+
+	GameResponse start(const ShipParams& params){ return start_async(params).get(); }
+
+	GameResponse command(const CommandListBuilder& cl){ return command_async(cl).get(); }
+
 };
 
 }
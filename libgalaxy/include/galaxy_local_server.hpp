@@ -0,0 +1,517 @@
+#ifndef LIBGALAXY_GALAXY_LOCAL_SERVER_HPP
+#define LIBGALAXY_GALAXY_LOCAL_SERVER_HPP
+
+#include <random>
+#include "galaxy_trajectory.hpp"
+
+
+namespace galaxy {
+
+//----------------------------------------------------------------------------
+// Game rules
+//----------------------------------------------------------------------------
+struct GameRules {
+	long time_limit;
+	long galaxy_radius;      // ships at or inside this square are destroyed
+	long universe_radius;    // ships outside this square are destroyed
+	long attacker_capacity;  // budget for the initial ShipParams
+	long defender_capacity;
+	long max_heat;
+	long max_accel;          // per axis and per turn
+	long spawn_distance;
+
+	GameRules()
+		: time_limit(256)
+		, galaxy_radius(16)
+		, universe_radius(128)
+		, attacker_capacity(512)
+		, defender_capacity(448)
+		, max_heat(64)
+		, max_accel(2)
+		, spawn_distance(48)
+	{ }
+};
+
+namespace rules {
+
+inline long chebyshev(const Vec& a, const Vec& b){
+	return std::max(std::abs(a.x - b.x), std::abs(a.y - b.y));
+}
+
+inline long param_cost(const ShipParams& p){
+	return p.x0 + 4 * p.x1 + 12 * p.x2 + 2 * p.x3;
+}
+
+inline bool valid_params(const ShipParams& p, long capacity){
+	return p.x0 >= 0 && p.x1 >= 0 && p.x2 >= 0 && p.x3 >= 1 && param_cost(p) <= capacity;
+}
+
+}
+
+
+//----------------------------------------------------------------------------
+// Simulator
+//----------------------------------------------------------------------------
+// One match between an attacker and a defender, independent of the protocol.
+// A turn applies commands (accel, fork, detonate, shoot), moves every ship
+// under gravity, resolves shots, cools ships and removes the destroyed ones.
+// Shot and detonation damage follow simplified formulas.
+class LocalGame {
+
+public:
+	struct Ship {
+		ShipState            state;
+		std::vector<Element> applied;  // commands applied in the last turn
+	};
+
+private:
+	struct Shot {
+		Vec  target;
+		long power;
+	};
+
+	GameRules         m_rules;
+	GameStage         m_stage;
+	long              m_tick;
+	PlayerRole        m_winner;
+	std::vector<Ship> m_ships;
+	long              m_next_id;
+	std::mt19937_64   m_rng;
+
+	Ship *find_ship(PlayerRole role, long id){
+		for(auto& s : m_ships){
+			if(s.state.id == id && s.state.role == role){ return &s; }
+		}
+		return nullptr;
+	}
+
+	// Excess heat burns fuel, then cooling, then power
+	static bool overheat(ShipState& s, long max_heat){
+		long excess = s.x5 - max_heat;
+		if(excess <= 0){ return true; }
+		s.x5 = max_heat;
+		for(long *x : { &s.params.x0, &s.params.x2, &s.params.x1 }){
+			const long burnt = std::min(*x, excess);
+			*x -= burnt;
+			excess -= burnt;
+		}
+		return excess == 0;
+	}
+
+	void apply_commands(PlayerRole role, const Element& commands,
+	                    std::vector<Vec>& thrust, std::vector<Shot>& shots,
+	                    std::vector<bool>& detonated)
+	{
+		for(const auto& command : commands.as_list()){
+			const auto c = command.as_list();
+			if(c.size() < 2){ continue; }
+			Ship *ship = find_ship(role, c[1].as_number());
+			if(!ship){ continue; }
+			const size_t index = ship - m_ships.data();
+			auto& s = ship->state;
+			const long type = c[0].as_number();
+			if(type == 0 && c.size() >= 3){
+				const Vec v = c[2].as_vector();
+				const long cost = std::max(std::abs(v.x), std::abs(v.y));
+				if(cost == 0 || cost > m_rules.max_accel || cost > s.params.x0){ continue; }
+				if(thrust[index].x != 0 || thrust[index].y != 0){ continue; }
+				s.params.x0 -= cost;
+				s.x5 += 8 * cost;
+				thrust[index] = v;
+				ship->applied.push_back(Element{ 0, v });
+			}else if(type == 1){
+				detonated[index] = true;
+				ship->applied.push_back(Element{ 1 });
+			}else if(type == 2 && c.size() >= 4){
+				const long power = std::min(c[3].as_number(), s.params.x1);
+				if(power <= 0){ continue; }
+				s.x5 += power;
+				shots[index] = Shot{ c[2].as_vector(), power };
+				ship->applied.push_back(Element{ 2, c[2].as_vector(), power });
+			}else if(type == 3 && c.size() >= 3){
+				const auto p = ShipParams::decode(c[2]);
+				if(p.x0 < 0 || p.x1 < 0 || p.x2 < 0 || p.x3 < 1){ continue; }
+				if(p.x0 > s.params.x0 || p.x1 > s.params.x1 || p.x2 > s.params.x2 || p.x3 >= s.params.x3){ continue; }
+				s.params.x0 -= p.x0;
+				s.params.x1 -= p.x1;
+				s.params.x2 -= p.x2;
+				s.params.x3 -= p.x3;
+				Ship child;
+				child.state = s;
+				child.state.id = m_next_id++;
+				child.state.params = p;
+				child.state.x5 = 0;
+				ship->applied.push_back(Element{ 3, p.encode() });
+				m_ships.push_back(std::move(child));  // invalidates `ship`
+				thrust.emplace_back();
+				shots.push_back(Shot{ Vec(), 0 });
+				detonated.push_back(false);
+			}
+		}
+	}
+
+public:
+	explicit LocalGame(GameRules rules = GameRules(), uint64_t seed = 0)
+		: m_rules(rules)
+		, m_stage(GameStage::NOT_STARTED)
+		, m_tick(0)
+		, m_winner(PlayerRole::DEFENDER)
+		, m_ships()
+		, m_next_id(0)
+		, m_rng(seed)
+	{ }
+
+	const GameRules& rules() const { return m_rules; }
+	GameStage stage() const { return m_stage; }
+	long tick() const { return m_tick; }
+	const std::vector<Ship>& ships() const { return m_ships; }
+
+	// Valid once the game is finished
+	PlayerRole winner() const { return m_winner; }
+
+	// Ends the game in favor of the other side
+	void resign(PlayerRole role){
+		if(m_stage == GameStage::COMPLETED){ return; }
+		m_stage  = GameStage::COMPLETED;
+		m_winner = (role == PlayerRole::ATTACKER ? PlayerRole::DEFENDER : PlayerRole::ATTACKER);
+	}
+
+	long capacity(PlayerRole role) const {
+		return role == PlayerRole::ATTACKER ? m_rules.attacker_capacity : m_rules.defender_capacity;
+	}
+
+	// Spawns one ship per side at mirrored positions at rest
+	void start(const ShipParams& attacker, const ShipParams& defender){
+		const long r = m_rules.spawn_distance;
+		std::uniform_int_distribution<long> offset(-r, r);
+		const long side = (m_rng() & 1) ? r : -r;
+		const Vec p = (m_rng() & 1) ? Vec(side, offset(m_rng)) : Vec(offset(m_rng), side);
+		for(const auto role : { PlayerRole::ATTACKER, PlayerRole::DEFENDER }){
+			Ship ship;
+			ship.state.role   = role;
+			ship.state.id     = m_next_id++;
+			ship.state.pos    = (role == PlayerRole::ATTACKER ? p : Vec(-p.x, -p.y));
+			ship.state.params = (role == PlayerRole::ATTACKER ? attacker : defender);
+			ship.state.x6     = m_rules.max_heat;
+			ship.state.x7     = m_rules.max_accel;
+			m_ships.push_back(std::move(ship));
+		}
+		m_stage = GameStage::RUNNING;
+	}
+
+	void step(const Element& attacker_commands, const Element& defender_commands){
+		if(m_stage != GameStage::RUNNING){ return; }
+		for(auto& s : m_ships){ s.applied.clear(); }
+		std::vector<Vec>  thrust(m_ships.size());
+		std::vector<Shot> shots(m_ships.size(), Shot{ Vec(), 0 });
+		std::vector<bool> detonated(m_ships.size(), false);
+		apply_commands(PlayerRole::ATTACKER, attacker_commands, thrust, shots, detonated);
+		apply_commands(PlayerRole::DEFENDER, defender_commands, thrust, shots, detonated);
+
+		std::vector<bool> destroyed(detonated);
+		for(size_t i = 0; i < m_ships.size(); ++i){
+			if(!detonated[i]){ continue; }
+			const auto& d = m_ships[i].state;
+			const long power = 32 + rules::param_cost(d.params) / 4;
+			for(size_t j = 0; j < m_ships.size(); ++j){
+				if(destroyed[j]){ continue; }
+				m_ships[j].state.x5 += std::max(0L, power - 8 * rules::chebyshev(d.pos, m_ships[j].state.pos));
+			}
+		}
+		for(size_t i = 0; i < m_ships.size(); ++i){
+			auto& s = m_ships[i].state;
+			const auto next = rules::simulate(s.pos, Vec(s.vel.x - thrust[i].x, s.vel.y - thrust[i].y));
+			s.pos = next.first;
+			s.vel = next.second;
+		}
+		for(size_t i = 0; i < m_ships.size(); ++i){
+			if(destroyed[i] || shots[i].power == 0){ continue; }
+			for(size_t j = 0; j < m_ships.size(); ++j){
+				if(j == i || destroyed[j]){ continue; }
+				const long dist = rules::chebyshev(shots[i].target, m_ships[j].state.pos);
+				m_ships[j].state.x5 += std::max(0L, 3 * shots[i].power - 8 * dist);
+			}
+		}
+		for(size_t i = 0; i < m_ships.size(); ++i){
+			auto& s = m_ships[i].state;
+			s.x5 = std::max(0L, s.x5 - s.params.x2);
+			const long r = rules::chebyshev(s.pos, Vec());
+			if(!overheat(s, m_rules.max_heat) || r <= m_rules.galaxy_radius || r > m_rules.universe_radius){
+				destroyed[i] = true;
+			}
+		}
+
+		std::vector<Ship> survivors;
+		bool alive[2] = { false, false };
+		for(size_t i = 0; i < m_ships.size(); ++i){
+			if(destroyed[i]){ continue; }
+			alive[static_cast<int>(m_ships[i].state.role)] = true;
+			survivors.push_back(std::move(m_ships[i]));
+		}
+		m_ships = std::move(survivors);
+		++m_tick;
+
+		const bool attacker_alive = alive[static_cast<int>(PlayerRole::ATTACKER)];
+		const bool defender_alive = alive[static_cast<int>(PlayerRole::DEFENDER)];
+		if(!defender_alive || !attacker_alive || m_tick >= m_rules.time_limit){
+			m_stage  = GameStage::COMPLETED;
+			m_winner = (attacker_alive && !defender_alive ? PlayerRole::ATTACKER : PlayerRole::DEFENDER);
+		}
+	}
+
+	Element encode_static_info(PlayerRole role) const {
+		return Element{
+			m_rules.time_limit,
+			static_cast<long>(role),
+			Element{ capacity(role), m_rules.max_heat, m_rules.max_accel },
+			Element{ m_rules.galaxy_radius, m_rules.universe_radius },
+			Element()
+		};
+	}
+
+	Element encode_state() const {
+		if(m_stage == GameStage::NOT_STARTED){ return Element(); }
+		std::vector<Element> ships;
+		ships.reserve(m_ships.size());
+		for(const auto& ship : m_ships){
+			const auto& s = ship.state;
+			ships.push_back(Element{
+				Element{
+					static_cast<long>(s.role), s.id, s.pos, s.vel,
+					s.params.encode(), s.x5, s.x6, s.x7
+				},
+				Element(ship.applied)
+			});
+		}
+		return Element{
+			m_tick,
+			Element{ m_rules.galaxy_radius, m_rules.universe_radius },
+			Element(std::move(ships))
+		};
+	}
+
+};
+
+
+//----------------------------------------------------------------------------
+// Server
+//----------------------------------------------------------------------------
+// Serves create_room/join/start/command queries for any number of rooms.
+// It can be passed to GalaxyContext as a QueryFunction; start and command
+// responses become ready once both players of the room have sent theirs.
+class LocalServer {
+
+private:
+	struct Room {
+		LocalGame                 game;
+		bool                      started[2];
+		ShipParams                params[2];
+		bool                      submitted[2];
+		Element                   commands[2];
+		bool                      pending[2];
+		std::promise<std::string> waiting[2];
+		uint64_t                  answered_at[2];
+		LatencyHistogram          turn_latency[2];  // from a response to the next command
+
+		Room(const GameRules& rules, uint64_t seed)
+			: game(rules, seed)
+			, started{ false, false }
+			, params()
+			, submitted{ false, false }
+			, commands()
+			, pending{ false, false }
+			, waiting()
+			, answered_at{ 0, 0 }
+			, turn_latency()
+		{ }
+	};
+
+	struct Player {
+		std::shared_ptr<Room> room;
+		PlayerRole            role;
+	};
+
+	struct State {
+		std::mutex                         mutex;
+		GameRules                          rules;
+		std::mt19937_64                    rng;
+		std::unordered_map<long, Player>   players;
+	};
+
+	std::shared_ptr<State> m_state;
+
+	static std::string error_response(){
+		return modulate(Element{ 0 });
+	}
+
+	static std::string game_response(const Room& room, PlayerRole role){
+		return modulate(Element{
+			1,
+			static_cast<long>(room.game.stage()),
+			room.game.encode_static_info(role),
+			room.game.encode_state()
+		});
+	}
+
+	static void wait_for_other(Room& room, int self, std::promise<std::string>& promise){
+		room.pending[self] = true;
+		room.waiting[self] = std::move(promise);
+	}
+
+	static void answer_waiting(Room& room, int side){
+		if(!room.pending[side]){ return; }
+		room.pending[side] = false;
+		room.waiting[side].set_value(game_response(room, static_cast<PlayerRole>(side)));
+		room.waiting[side] = std::promise<std::string>();
+		room.answered_at[side] = detail::now_ns();
+	}
+
+	// Answers both players once they have both started or commanded
+	static void answer_both(Room& room, int self, std::promise<std::string>& promise){
+		answer_waiting(room, 1 - self);
+		promise.set_value(game_response(room, static_cast<PlayerRole>(self)));
+		room.answered_at[self] = detail::now_ns();
+	}
+
+	RoomInfo add_room(uint64_t seed){
+		auto room = std::make_shared<Room>(m_state->rules, seed);
+		std::uniform_int_distribution<long> dist(1000000000L, 9999999999L);
+		long keys[2];
+		for(int i = 0; i < 2; ++i){
+			do { keys[i] = dist(m_state->rng); } while(m_state->players.count(keys[i]));
+			m_state->players[keys[i]] = Player{ room, static_cast<PlayerRole>(i) };
+		}
+		RoomInfo info;
+		info.attacker_key = keys[0];
+		info.defender_key = keys[1];
+		return info;
+	}
+
+	const Player& find_player(long key) const {
+		const auto it = m_state->players.find(key);
+		if(it == m_state->players.end()){
+			throw std::runtime_error("unknown player key: " + std::to_string(key));
+		}
+		return it->second;
+	}
+
+	std::future<std::string> handle(const Element& q){
+		std::promise<std::string> promise;
+		auto future = promise.get_future();
+		const auto l = q.as_list();
+		const long type = (l.size() >= 1 ? l[0].as_number() : 0);
+		if(type == 1){
+			const auto info = add_room(m_state->rng());
+			promise.set_value(modulate(Element{
+				1, Element{ Element{ 0, info.attacker_key }, Element{ 1, info.defender_key } }
+			}));
+			return future;
+		}
+
+		auto it = (l.size() >= 2 ? m_state->players.find(l[1].as_number()) : m_state->players.end());
+		if(it == m_state->players.end() || type < 2 || type > 4){
+			promise.set_value(error_response());
+			return future;
+		}
+		Room& room = *it->second.room;
+		const PlayerRole role = it->second.role;
+		const int self = static_cast<int>(role), other = 1 - self;
+
+		if(type == 2 || room.game.stage() == GameStage::COMPLETED){
+			promise.set_value(game_response(room, role));
+		}else if(type == 3){
+			const auto params = (l.size() >= 3 ? ShipParams::decode(l[2]) : ShipParams());
+			if(room.started[self] || !rules::valid_params(params, room.game.capacity(role))){
+				promise.set_value(error_response());
+			}else{
+				room.started[self] = true;
+				room.params[self]  = params;
+				if(!room.started[other]){
+					wait_for_other(room, self, promise);
+				}else{
+					room.game.start(room.params[0], room.params[1]);
+					answer_both(room, self, promise);
+				}
+			}
+		}else if(room.game.stage() != GameStage::RUNNING || room.submitted[self]){
+			promise.set_value(error_response());
+		}else{
+			room.submitted[self] = true;
+			room.commands[self]  = (l.size() >= 3 ? l[2] : Element());
+			room.turn_latency[self].record(detail::now_ns() - room.answered_at[self]);
+			if(!room.submitted[other]){
+				wait_for_other(room, self, promise);
+			}else{
+				room.game.step(room.commands[0], room.commands[1]);
+				room.submitted[0] = room.submitted[1] = false;
+				answer_both(room, self, promise);
+			}
+		}
+		return future;
+	}
+
+public:
+	explicit LocalServer(GameRules rules = GameRules(), uint64_t seed = 0)
+		: m_state(std::make_shared<State>())
+	{
+		m_state->rules = rules;
+		m_state->rng.seed(seed);
+	}
+
+	std::future<std::string> operator()(const std::string& body, HttpTiming *timing = nullptr){
+		if(timing){ *timing = HttpTiming(); }
+		std::lock_guard<std::mutex> lock(m_state->mutex);
+		try {
+			return handle(demodulate(body));
+		}catch(std::runtime_error&){
+			std::promise<std::string> promise;
+			promise.set_value(error_response());
+			return promise.get_future();
+		}
+	}
+
+	// Creates a room whose game is seeded independently of the creation order
+	RoomInfo create_room(uint64_t seed){
+		std::lock_guard<std::mutex> lock(m_state->mutex);
+		return add_room(seed);
+	}
+
+	// Forfeits the game of `key` and releases the other player if it waits
+	void resign(long key){
+		std::lock_guard<std::mutex> lock(m_state->mutex);
+		const auto& player = find_player(key);
+		Room& room = *player.room;
+		room.game.resign(player.role);
+		answer_waiting(room, 0);
+		answer_waiting(room, 1);
+	}
+
+	GameStage stage(long key) const {
+		std::lock_guard<std::mutex> lock(m_state->mutex);
+		return find_player(key).room->game.stage();
+	}
+
+	long tick(long key) const {
+		std::lock_guard<std::mutex> lock(m_state->mutex);
+		return find_player(key).room->game.tick();
+	}
+
+	// Valid once stage(key) is COMPLETED
+	PlayerRole winner(long key) const {
+		std::lock_guard<std::mutex> lock(m_state->mutex);
+		return find_player(key).room->game.winner();
+	}
+
+	// Time the player of `key` took between receiving a response and sending
+	// its next command, copied under the lock so that matches may still run.
+	LatencyHistogram turn_latency(long key) const {
+		std::lock_guard<std::mutex> lock(m_state->mutex);
+		const auto& player = find_player(key);
+		return player.room->turn_latency[static_cast<int>(player.role)];
+	}
+
+};
+
+}
+
+#endif
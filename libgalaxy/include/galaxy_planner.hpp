@@ -0,0 +1,343 @@
+#ifndef LIBGALAXY_GALAXY_PLANNER_HPP
+#define LIBGALAXY_GALAXY_PLANNER_HPP
+
+#include "galaxy_survival.hpp"
+
+
+namespace galaxy {
+
+//----------------------------------------------------------------------------
+// Transposition table
+//----------------------------------------------------------------------------
+namespace detail {
+
+// Open-addressing map from (pos, vel, depth) to the least fuel that reached
+// it. Clearing only bumps a generation, so one table serves every turn.
+class TranspositionTable {
+
+private:
+	struct Entry {
+		uint64_t state;
+		uint32_t generation;
+		int32_t  depth;
+		long     fuel;
+	};
+
+	std::vector<Entry> m_entries;
+	uint32_t           m_generation;
+	size_t             m_count;
+
+	static uint64_t pack(const Vec& p, const Vec& v){
+		const auto field = [](long x){ return static_cast<uint64_t>(static_cast<uint16_t>(x)); };
+		return field(p.x) | (field(p.y) << 16) | (field(v.x) << 32) | (field(v.y) << 48);
+	}
+
+	static uint64_t mix(uint64_t x){
+		x ^= x >> 30; x *= 0xbf58476d1ce4e5b9ULL;
+		x ^= x >> 27; x *= 0x94d049bb133111ebULL;
+		return x ^ (x >> 31);
+	}
+
+	void grow(){
+		std::vector<Entry> old(m_entries.size() * 2, Entry{ 0, 0, 0, 0 });
+		old.swap(m_entries);
+		m_count = 0;
+		for(const auto& e : old){
+			if(e.generation == m_generation){ insert(e.state, e.depth, e.fuel); }
+		}
+	}
+
+	// Returns false if the state was already reached with no more fuel
+	bool insert(uint64_t state, int32_t depth, long fuel){
+		const size_t mask = m_entries.size() - 1;
+		for(size_t i = mix(state ^ (static_cast<uint64_t>(depth) << 58)) & mask; ; i = (i + 1) & mask){
+			auto& e = m_entries[i];
+			if(e.generation != m_generation){
+				e = Entry{ state, m_generation, depth, fuel };
+				++m_count;
+				return true;
+			}
+			if(e.state == state && e.depth == depth){
+				if(e.fuel <= fuel){ return false; }
+				e.fuel = fuel;
+				return true;
+			}
+		}
+	}
+
+public:
+	explicit TranspositionTable(size_t capacity = 1 << 16)
+		: m_entries()
+		, m_generation(1)
+		, m_count(0)
+	{
+		size_t n = 16;
+		while(n < capacity){ n *= 2; }
+		m_entries.assign(n, Entry{ 0, 0, 0, 0 });
+	}
+
+	size_t size() const { return m_count; }
+
+	void clear(){
+		if(++m_generation == 0){
+			for(auto& e : m_entries){ e.generation = 0; }
+			m_generation = 1;
+		}
+		m_count = 0;
+	}
+
+	// Records the state. Coordinates must fit in 16 bits, which holds for
+	// every ship inside the universe.
+	bool improve(const Vec& p, const Vec& v, long depth, long fuel){
+		if(2 * (m_count + 1) > m_entries.size()){ grow(); }
+		return insert(pack(p, v), static_cast<int32_t>(depth), fuel);
+	}
+
+	// Least fuel recorded for the state, -1 if it was not reached
+	long fuel(const Vec& p, const Vec& v, long depth) const {
+		const uint64_t state = pack(p, v);
+		const int32_t d = static_cast<int32_t>(depth);
+		const size_t mask = m_entries.size() - 1;
+		for(size_t i = mix(state ^ (static_cast<uint64_t>(d) << 58)) & mask; ; i = (i + 1) & mask){
+			const auto& e = m_entries[i];
+			if(e.generation != m_generation){ return -1; }
+			if(e.state == state && e.depth == d){ return e.fuel; }
+		}
+	}
+
+};
+
+}
+
+
+//----------------------------------------------------------------------------
+// Orbit insertion
+//----------------------------------------------------------------------------
+struct OrbitSearchOptions {
+	size_t beam_width;   // states kept per turn
+	long   max_accel;    // per axis
+	long   max_depth;    // turns of thrust planned at most
+	double fuel_weight;  // turns of survival one unit of fuel is worth
+	double cheap_share;  // part of the beam kept for the cheapest states
+
+	OrbitSearchOptions()
+		: beam_width(512)
+		, max_accel(1)
+		, max_depth(32)
+		, fuel_weight(4.0)
+		, cheap_share(0.25)
+	{ }
+};
+
+struct OrbitPlan {
+	bool             found;     // coasting after `accels` survives every remaining turn
+	std::vector<Vec> accels;    // accel commands for this turn and the following ones
+	long             fuel;
+	long             lifetime;  // turns survived when coasting after the plan
+	long             depth;     // turns of thrust fully searched
+	size_t           expanded;
+	bool             complete;  // the deadline did not cut the search short
+
+	OrbitPlan()
+		: found(false)
+		, accels()
+		, fuel(0)
+		, lifetime(0)
+		, depth(0)
+		, expanded(0)
+		, complete(true)
+	{ }
+};
+
+// Searches for a cheap accel sequence after which a coasting ship survives
+// until the end of the game. The search is a beam over turns; states are
+// deduplicated by (pos, vel, turn) and ranked by how long they survive
+// when coasting, minus a fuel penalty, while a share of the beam keeps the
+// cheapest states so that slow but frugal plans are not cut early. Plans
+// cheaper than the best one found so far are the only ones expanded, so the
+// search stops once no cheaper plan can exist or the deadline passes. The
+// beam makes this a heuristic: the result is the cheapest plan among the
+// states kept, not necessarily the cheapest one overall. Without a goal the
+// partial plan that survives the longest is returned.
+class OrbitPlanner {
+
+public:
+	using clock = std::chrono::steady_clock;
+
+private:
+	struct Node {
+		Vec     pos;
+		Vec     vel;
+		Vec     accel;   // applied on the way from the parent
+		int32_t parent;
+		long    depth;
+		long    fuel;
+		long    lifetime;  // from `depth` on
+	};
+
+	long                        m_universe_radius;
+	long                        m_galaxy_radius;
+	OrbitSearchOptions          m_options;
+	const SurvivalTable        *m_table;
+	detail::TranspositionTable  m_visited;
+	TrajectoryBatch             m_batch;
+	std::vector<Node>           m_nodes;
+	std::vector<Node>           m_children;
+	std::vector<int32_t>        m_layer;
+	std::vector<size_t>         m_order;
+
+	// Coasting lifetimes of m_children, capped at `need`
+	void evaluate(long need){
+		if(m_table && m_table->horizon() >= need){
+			for(auto& c : m_children){ c.lifetime = std::min(need, m_table->lifetime(c.pos, c.vel)); }
+			return;
+		}
+		m_batch.clear();
+		m_batch.reserve(m_children.size());
+		for(const auto& c : m_children){ m_batch.add(c.pos, c.vel); }
+		m_batch.run(need, m_universe_radius, m_galaxy_radius);
+		for(size_t i = 0; i < m_children.size(); ++i){ m_children[i].lifetime = m_batch.lifetime(i); }
+	}
+
+	OrbitPlan make_plan(int32_t index, bool found, long depth, size_t expanded) const {
+		OrbitPlan plan;
+		plan.found    = found;
+		plan.fuel     = m_nodes[index].fuel;
+		plan.lifetime = m_nodes[index].lifetime;
+		plan.depth    = depth;
+		plan.expanded = expanded;
+		for(int32_t i = index; m_nodes[i].parent >= 0; i = m_nodes[i].parent){
+			plan.accels.push_back(m_nodes[i].accel);
+		}
+		std::reverse(plan.accels.begin(), plan.accels.end());
+		return plan;
+	}
+
+	bool alive(const Vec& p) const {
+		const long r = std::max(std::abs(p.x), std::abs(p.y));
+		return m_galaxy_radius < r && r <= m_universe_radius;
+	}
+
+public:
+	// `table` is optional and used when its horizon covers the remaining turns
+	OrbitPlanner(long universe_radius, long galaxy_radius,
+	             OrbitSearchOptions options = OrbitSearchOptions(),
+	             const SurvivalTable *table = nullptr)
+		: m_universe_radius(universe_radius)
+		, m_galaxy_radius(galaxy_radius)
+		, m_options(options)
+		, m_table(table)
+		, m_visited()
+		, m_batch()
+		, m_nodes()
+		, m_children()
+		, m_layer()
+		, m_order()
+	{ }
+
+	const OrbitSearchOptions& options() const { return m_options; }
+	void set_options(const OrbitSearchOptions& options){ m_options = options; }
+
+	// `turns` is how long the ship has to survive, `max_fuel` what it may spend
+	OrbitPlan plan(const Vec& pos, const Vec& vel, long turns, long max_fuel, clock::time_point deadline){
+		m_nodes.clear();
+		m_layer.clear();
+		m_visited.clear();
+
+		m_children.assign(1, Node{ pos, vel, Vec(), -1, 0, 0, 0 });
+		evaluate(turns);
+		m_nodes.push_back(m_children[0]);
+		if(m_nodes[0].lifetime >= turns){ return make_plan(0, true, 0, 0); }
+
+		int32_t best = -1;           // cheapest goal
+		int32_t most_promising = 0;  // best partial plan by turns survived, then fuel
+		long depth = 0;
+		size_t expanded = 0;
+		bool complete = true;
+		const long m = m_options.max_accel;
+		m_layer.push_back(0);
+		for(long t = 1; t <= std::min(m_options.max_depth, turns); ++t){
+			if(m_layer.empty()){ break; }
+			if(clock::now() >= deadline){
+				complete = false;
+				break;
+			}
+			if(best >= 0 && m_nodes[best].fuel <= 1){ break; }  // nothing cheaper is left
+
+			// Expand
+			m_children.clear();
+			for(const int32_t parent : m_layer){
+				const Node& n = m_nodes[parent];
+				for(long ay = -m; ay <= m; ++ay){
+					for(long ax = -m; ax <= m; ++ax){
+						const long fuel = n.fuel + std::max(std::abs(ax), std::abs(ay));
+						if(fuel > max_fuel || (best >= 0 && fuel >= m_nodes[best].fuel)){ continue; }
+						const auto next = rules::simulate(n.pos, Vec(n.vel.x - ax, n.vel.y - ay));
+						if(!alive(next.first)){ continue; }
+						if(!m_visited.improve(next.first, next.second, t, fuel)){ continue; }
+						m_children.push_back(Node{ next.first, next.second, Vec(ax, ay), parent, t, fuel, 0 });
+					}
+				}
+			}
+			// Drop children that a cheaper path to the same state superseded
+			m_children.erase(std::remove_if(m_children.begin(), m_children.end(), [&](const Node& c){
+				return m_visited.fuel(c.pos, c.vel, t) < c.fuel;
+			}), m_children.end());
+			expanded += m_children.size();
+			const long need = turns - t;
+			evaluate(need);
+			if(clock::now() >= deadline){  // the layer may be incomplete
+				complete = false;
+				break;
+			}
+
+			// Goals leave the beam; the rest is ranked by lifetime minus fuel,
+			// except for a share that goes to the cheapest states
+			m_order.clear();
+			for(size_t i = 0; i < m_children.size(); ++i){
+				const Node& c = m_children[i];
+				if(c.lifetime >= need){
+					if(best < 0 || c.fuel < m_nodes[best].fuel){
+						best = static_cast<int32_t>(m_nodes.size());
+						m_nodes.push_back(c);
+					}
+				}else if(best < 0 || c.fuel + 1 < m_nodes[best].fuel){
+					m_order.push_back(i);
+				}
+			}
+			const double w = m_options.fuel_weight;
+			const auto score = [&](size_t i){ return m_children[i].lifetime - w * m_children[i].fuel; };
+			const size_t keep = std::min(m_order.size(), m_options.beam_width);
+			const size_t cheap = std::min(keep, static_cast<size_t>(m_options.beam_width * m_options.cheap_share));
+			std::partial_sort(m_order.begin(), m_order.begin() + (keep - cheap), m_order.end(),
+				[&](size_t a, size_t b){ return score(a) > score(b); });
+			std::partial_sort(m_order.begin() + (keep - cheap), m_order.begin() + keep, m_order.end(),
+				[&](size_t a, size_t b){
+					const Node& x = m_children[a];
+					const Node& y = m_children[b];
+					return x.fuel < y.fuel || (x.fuel == y.fuel && x.lifetime > y.lifetime);
+				});
+			m_layer.clear();
+			for(size_t k = 0; k < keep; ++k){
+				const Node& c = m_children[m_order[k]];
+				const Node& p = m_nodes[most_promising];
+				const long survived = c.depth + c.lifetime, best_survived = p.depth + p.lifetime;
+				const bool promising = survived > best_survived || (survived == best_survived && c.fuel < p.fuel);
+				m_layer.push_back(static_cast<int32_t>(m_nodes.size()));
+				m_nodes.push_back(c);
+				if(promising){ most_promising = m_layer.back(); }
+			}
+			depth = t;
+		}
+		auto plan = (best >= 0
+			? make_plan(best, true, depth, expanded)
+			: make_plan(most_promising, false, depth, expanded));
+		plan.complete = complete;
+		return plan;
+	}
+
+};
+
+}
+
+#endif
@@ -0,0 +1,96 @@
+#ifndef LIBGALAXY_GALAXY_SCHEDULER_HPP
+#define LIBGALAXY_GALAXY_SCHEDULER_HPP
+
+#include "galaxy.hpp"
+
+
+namespace galaxy {
+
+//----------------------------------------------------------------------------
+// Turn scheduler
+//----------------------------------------------------------------------------
+enum class IterationResult {
+	TIMED_OUT,  // cut short by the deadline; its result is discarded
+	DEEPER,     // complete; a deeper iteration may improve it
+	DONE        // complete; deeper iterations cannot improve it
+};
+
+// Runs iterative deepening within the time left in the current turn. The
+// turn starts when GalaxyContext received the latest response and the
+// deadline is `budget - margin` after that, where `margin` covers encoding
+// and sending the commands. A search is called with increasing depths
+// while the next one is expected to finish in time, judging by how much
+// the previous iterations grew. The result of the deepest complete iteration
+// is returned, or `fallback` if none completed.
+class TurnScheduler {
+
+public:
+	using clock = std::chrono::steady_clock;
+
+private:
+	clock::duration m_budget;
+	clock::duration m_margin;
+	long            m_depth;     // of the last turn
+	size_t          m_turns;
+	size_t          m_overruns;  // turns that returned after their deadline
+
+public:
+	explicit TurnScheduler(
+		clock::duration budget,
+		clock::duration margin = std::chrono::milliseconds(5))
+		: m_budget(budget)
+		, m_margin(margin)
+		, m_depth(0)
+		, m_turns(0)
+		, m_overruns(0)
+	{ }
+
+	clock::time_point deadline(const GalaxyContext& ctx) const {
+		const uint64_t received = ctx.received_at();
+		const auto start = (received == 0
+			? clock::now()
+			: clock::time_point(std::chrono::duration_cast<clock::duration>(std::chrono::nanoseconds(received))));
+		return start + m_budget - m_margin;
+	}
+
+	// `search(depth, deadline, result)` fills a copy of `fallback` for one
+	// depth, starting at 1, and has to return IterationResult::TIMED_OUT soon
+	// after the deadline passes.
+	template <typename Result, typename Search>
+	Result run(const GalaxyContext& ctx, Search&& search, Result fallback, long max_depth){
+		const auto until = deadline(ctx);
+		Result best = fallback;
+		long depth = 0;
+		clock::duration last(0);
+		double growth = 2.0;
+		for(long d = 1; d <= max_depth; ++d){
+			const auto begin = clock::now();
+			if(d > 1 && begin + std::chrono::duration_cast<clock::duration>(last * growth) >= until){ break; }
+			Result result = fallback;
+			const auto r = search(d, until, result);
+			if(r == IterationResult::TIMED_OUT){ break; }
+			best = std::move(result);
+			depth = d;
+			if(r == IterationResult::DONE){ break; }
+			const auto elapsed = clock::now() - begin;
+			if(last.count() > 0){
+				growth = std::max(1.0, static_cast<double>(elapsed.count()) / last.count());
+			}
+			last = elapsed;
+		}
+		m_depth = depth;
+		++m_turns;
+		if(clock::now() > until){ ++m_overruns; }
+		return best;
+	}
+
+	// Deepest complete iteration of the last turn, 0 if none completed
+	long depth() const { return m_depth; }
+	size_t turns() const { return m_turns; }
+	size_t overruns() const { return m_overruns; }
+
+};
+
+}
+
+#endif
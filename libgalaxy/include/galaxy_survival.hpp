@@ -0,0 +1,208 @@
+#ifndef LIBGALAXY_GALAXY_SURVIVAL_HPP
+#define LIBGALAXY_GALAXY_SURVIVAL_HPP
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "galaxy_trajectory.hpp"
+
+
+namespace galaxy {
+
+//----------------------------------------------------------------------------
+// Survival table
+//----------------------------------------------------------------------------
+// Turns a coasting ship survives, capped at `horizon`, for every position
+// inside the universe and every velocity up to `max_speed` per axis.
+// A turn maps (p, v) to (p + v + g(p), v + g(p)), which is invertible:
+// v = v' - g(p' - v'). The state space is therefore made of disjoint chains
+// and cycles. Each chain is filled backward from its last state inside the
+// table, whose successor either dies or leaves the table and is traced
+// directly. States never reached lie on closed orbits and survive forever.
+// Tables are saved as a header followed by raw uint16 values and are
+// memory-mapped when opened.
+class SurvivalTable {
+
+public:
+	static const uint32_t VERSION = 1;
+
+private:
+	struct Header {
+		char     magic[4];
+		uint32_t version;
+		int32_t  universe_radius;
+		int32_t  galaxy_radius;
+		int32_t  max_speed;
+		int32_t  horizon;
+	};
+
+	static const uint16_t UNKNOWN = 0xffff;
+
+	Header                m_header;
+	std::shared_ptr<void> m_storage;  // owns the vector or the mapping behind m_data
+	const uint16_t       *m_data;
+
+	long pos_width() const { return 2 * m_header.universe_radius + 1; }
+	long vel_width() const { return 2 * m_header.max_speed + 1; }
+	size_t num_states() const {
+		return static_cast<size_t>(pos_width() * pos_width()) * (vel_width() * vel_width());
+	}
+
+	static const char *magic(){ return "GXST"; }
+
+	bool in_table(const Vec& p, const Vec& v) const {
+		const long ur = m_header.universe_radius, vm = m_header.max_speed;
+		return std::abs(p.x) <= ur && std::abs(p.y) <= ur && std::abs(v.x) <= vm && std::abs(v.y) <= vm;
+	}
+
+	bool alive(const Vec& p) const {
+		const long r = std::max(std::abs(p.x), std::abs(p.y));
+		return m_header.galaxy_radius < r && r <= m_header.universe_radius;
+	}
+
+	size_t index(const Vec& p, const Vec& v) const {
+		const long ur = m_header.universe_radius, vm = m_header.max_speed;
+		const long pos = (p.y + ur) * pos_width() + (p.x + ur);
+		const long vel = (v.y + vm) * vel_width() + (v.x + vm);
+		return static_cast<size_t>(pos) * (vel_width() * vel_width()) + vel;
+	}
+
+	std::pair<Vec, Vec> state(size_t i) const {
+		const long ur = m_header.universe_radius, vm = m_header.max_speed;
+		const long vel = static_cast<long>(i % (vel_width() * vel_width()));
+		const long pos = static_cast<long>(i / (vel_width() * vel_width()));
+		return std::make_pair(
+			Vec(pos % pos_width() - ur, pos / pos_width() - ur),
+			Vec(vel % vel_width() - vm, vel / vel_width() - vm));
+	}
+
+	long trace(Vec p, Vec v) const {
+		long lifetime = 0;
+		rules::trace(p, v, m_header.horizon, m_header.universe_radius, m_header.galaxy_radius, &lifetime);
+		return lifetime;
+	}
+
+	// Fills the chains ending at states in [first, last)
+	void fill_chains(uint16_t *data, size_t first, size_t last) const {
+		const long horizon = m_header.horizon;
+		for(size_t i = first; i < last; ++i){
+			const auto s = state(i);
+			if(!alive(s.first)){ continue; }
+			const auto next = rules::simulate(s.first, s.second);
+			long value = 0;
+			if(!alive(next.first)){
+				value = 0;
+			}else if(!in_table(next.first, next.second)){
+				value = std::min(horizon, 1 + trace(next.first, next.second));
+			}else{
+				continue;  // not the end of its chain
+			}
+			Vec p = s.first, v = s.second;
+			while(true){
+				data[index(p, v)] = static_cast<uint16_t>(value);
+				value = std::min(horizon, value + 1);
+				const Vec prev_p(p.x - v.x, p.y - v.y);
+				const Vec g = rules::gravity(prev_p);
+				const Vec prev_v(v.x - g.x, v.y - g.y);
+				if(!alive(prev_p) || !in_table(prev_p, prev_v)){ break; }
+				p = prev_p;
+				v = prev_v;
+			}
+		}
+	}
+
+	SurvivalTable()
+		: m_header()
+		, m_storage()
+		, m_data(nullptr)
+	{ }
+
+public:
+	// Builds a table in memory. `threads` = 0 uses every core.
+	SurvivalTable(long universe_radius, long galaxy_radius, long max_speed,
+	              long horizon = 256, size_t threads = 0)
+		: m_header()
+		, m_storage()
+		, m_data(nullptr)
+	{
+		if(universe_radius <= 0 || max_speed < 0 || horizon < 0 || horizon >= UNKNOWN){
+			throw std::runtime_error("invalid survival table parameters");
+		}
+		std::copy(magic(), magic() + 4, m_header.magic);
+		m_header.version         = VERSION;
+		m_header.universe_radius = static_cast<int32_t>(universe_radius);
+		m_header.galaxy_radius   = static_cast<int32_t>(galaxy_radius);
+		m_header.max_speed       = static_cast<int32_t>(max_speed);
+		m_header.horizon         = static_cast<int32_t>(horizon);
+
+		auto values = std::make_shared<std::vector<uint16_t>>(num_states(), uint16_t(UNKNOWN));
+		uint16_t *data = values->data();
+		if(threads == 0){ threads = std::max(1u, std::thread::hardware_concurrency()); }
+		const size_t n = values->size(), chunk = (n + threads - 1) / threads;
+		std::vector<std::thread> workers;
+		for(size_t first = 0; first < n; first += chunk){
+			workers.emplace_back([this, data, first, chunk, n]{
+				fill_chains(data, first, std::min(first + chunk, n));
+			});
+		}
+		for(auto& t : workers){ t.join(); }
+		for(size_t i = 0; i < n; ++i){
+			if(data[i] != UNKNOWN){ continue; }
+			data[i] = (alive(state(i).first) ? static_cast<uint16_t>(horizon) : 0);
+		}
+		m_storage = values;
+		m_data = data;
+	}
+
+	// Maps a table written by save()
+	static SurvivalTable open(const std::string& path){
+		const int fd = ::open(path.c_str(), O_RDONLY);
+		if(fd < 0){ throw std::runtime_error("failed to open " + path); }
+		struct stat st;
+		if(fstat(fd, &st) != 0){
+			::close(fd);
+			throw std::runtime_error("failed to stat " + path);
+		}
+		const size_t size = static_cast<size_t>(st.st_size);
+		void *p = (size >= sizeof(Header) ? mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0) : MAP_FAILED);
+		::close(fd);
+		if(p == MAP_FAILED){ throw std::runtime_error("failed to map " + path); }
+
+		SurvivalTable table;
+		table.m_storage = std::shared_ptr<void>(p, [size](void *q){ munmap(q, size); });
+		std::memcpy(&table.m_header, p, sizeof(Header));
+		if(!std::equal(magic(), magic() + 4, table.m_header.magic) || table.m_header.version != VERSION ||
+		   size != sizeof(Header) + table.num_states() * sizeof(uint16_t))
+		{
+			throw std::runtime_error("not a survival table: " + path);
+		}
+		table.m_data = reinterpret_cast<const uint16_t*>(static_cast<const char*>(p) + sizeof(Header));
+		return table;
+	}
+
+	void save(const std::string& path) const {
+		std::ofstream ofs(path, std::ios::binary);
+		ofs.write(reinterpret_cast<const char*>(&m_header), sizeof(Header));
+		ofs.write(reinterpret_cast<const char*>(m_data), num_states() * sizeof(uint16_t));
+		if(!ofs){ throw std::runtime_error("failed to write " + path); }
+	}
+
+	long universe_radius() const { return m_header.universe_radius; }
+	long galaxy_radius() const { return m_header.galaxy_radius; }
+	long max_speed() const { return m_header.max_speed; }
+	long horizon() const { return m_header.horizon; }
+
+	// Turns survived without thrust from (p, v), capped at horizon(); same
+	// as the lifetime of rules::trace. Positions that are already dead give 0
+	// and speeds above max_speed per axis fall back to tracing.
+	long lifetime(const Vec& p, const Vec& v) const {
+		if(!in_table(p, v)){ return alive(p) ? trace(p, v) : 0; }
+		return m_data[index(p, v)];
+	}
+
+};
+
+}
+
+#endif
@@ -0,0 +1,407 @@
+#ifndef LIBGALAXY_GALAXY_TRAJECTORY_HPP
+#define LIBGALAXY_GALAXY_TRAJECTORY_HPP
+
+#include <climits>
+#include "galaxy.hpp"
+
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+
+namespace galaxy {
+
+//----------------------------------------------------------------------------
+// Movement rules
+//----------------------------------------------------------------------------
+namespace rules {
+
+inline Vec gravity(const Vec& p){
+	const long abs_x = std::abs(p.x), abs_y = std::abs(p.y);
+	if(abs_x > abs_y){
+		return Vec(p.x > 0 ? -1 : 1, 0);
+	}else if(abs_x < abs_y){
+		return Vec(0, p.y > 0 ? -1 : 1);
+	}else{
+		return Vec(p.x > 0 ? -1 : 1, p.y > 0 ? -1 : 1);
+	}
+}
+
+// Position and velocity after one turn without thrust
+inline std::pair<Vec, Vec> simulate(const Vec& p0, const Vec& d0){
+	const Vec g = gravity(p0);
+	const Vec d(d0.x + g.x, d0.y + g.y);
+	const Vec p(p0.x + d.x, p0.y + d.y);
+	return std::make_pair(p, d);
+}
+
+}
+
+
+//----------------------------------------------------------------------------
+// Trajectories
+//----------------------------------------------------------------------------
+enum class TrajectoryFate {
+	ALIVE   = 0,
+	CRASHED = 1,  // at or inside the galaxy radius
+	ESCAPED = 2   // outside the universe radius
+};
+
+inline std::ostream& operator<<(std::ostream& os, TrajectoryFate f){
+	switch(f){
+	case TrajectoryFate::ALIVE:   return os << "Alive";
+	case TrajectoryFate::CRASHED: return os << "Crashed";
+	case TrajectoryFate::ESCAPED: return os << "Escaped";
+	}
+	return os << "Unknown";
+}
+
+namespace detail {
+
+// One turn of a ship thrusting by (ax, ay), as in the accel command.
+// A negative galaxy radius disables crashes.
+template <typename T>
+inline TrajectoryFate trajectory_step(T& x, T& y, T& vx, T& vy, T ax, T ay, T ur, T gr){
+	const T abs_x = (x < 0 ? -x : x), abs_y = (y < 0 ? -y : y);
+	const T gx = (abs_x >= abs_y ? (x > 0 ? -1 : 1) : 0);
+	const T gy = (abs_y >= abs_x ? (y > 0 ? -1 : 1) : 0);
+	vx += gx - ax;
+	vy += gy - ay;
+	x += vx;
+	y += vy;
+	const T nx = (x < 0 ? -x : x), ny = (y < 0 ? -y : y);
+	if(nx > ur || ny > ur){ return TrajectoryFate::ESCAPED; }
+	if(nx <= gr && ny <= gr){ return TrajectoryFate::CRASHED; }
+	return TrajectoryFate::ALIVE;
+}
+
+}
+
+namespace rules {
+
+// Coasts for up to `steps` turns and stops at the first crash or escape.
+// `pos` and `vel` are updated in place; `lifetime` gets the turns survived.
+inline TrajectoryFate trace(
+	Vec& pos, Vec& vel, long steps, long universe_radius, long galaxy_radius,
+	long *lifetime = nullptr)
+{
+	auto fate = TrajectoryFate::ALIVE;
+	long t = 0;
+	for(; t < steps; ++t){
+		fate = detail::trajectory_step<long>(
+			pos.x, pos.y, vel.x, vel.y, 0, 0, universe_radius, galaxy_radius);
+		if(fate != TrajectoryFate::ALIVE){ break; }
+	}
+	if(lifetime){ *lifetime = t; }
+	return fate;
+}
+
+}
+
+// Simulates many (position, velocity, thrust plan) candidates at once.
+// Candidates are stored as int32 struct-of-arrays. Built with -mavx2 (or
+// -march=native), eight candidates advance together in one AVX2 register;
+// a lane whose candidate crashes, escapes or finishes is written back and
+// refilled with the next one, so early exits never leave lanes idle.
+// Otherwise the same rules run candidate by candidate.
+class TrajectoryBatch {
+
+public:
+	static const size_t LANES = 8;
+
+private:
+	size_t               m_size;
+	size_t               m_plan_length;
+	std::vector<int32_t> m_px, m_py, m_vx, m_vy;
+	std::vector<int32_t> m_fate;
+	std::vector<int32_t> m_lifetime;
+	std::vector<int32_t> m_ax, m_ay;  // [(i / LANES * plan_length + step) * LANES + i % LANES]
+
+	static int32_t narrow(long x){
+		if(x < INT32_MIN || x > INT32_MAX){
+			throw std::runtime_error("trajectory coordinate out of range: " + std::to_string(x));
+		}
+		return static_cast<int32_t>(x);
+	}
+
+	static int32_t clamp(long x){
+		return static_cast<int32_t>(std::max<long>(INT32_MIN, std::min<long>(INT32_MAX, x)));
+	}
+
+	size_t thrust_index(size_t i, size_t step) const {
+		return (i / LANES * m_plan_length + step) * LANES + i % LANES;
+	}
+
+	void run_scalar(int32_t steps, int32_t ur, int32_t gr){
+		const int32_t plan = std::min<int32_t>(steps, m_plan_length);
+		for(size_t i = 0; i < m_size; ++i){
+			if(m_fate[i] != static_cast<int32_t>(TrajectoryFate::ALIVE)){ continue; }
+			int32_t x = m_px[i], y = m_py[i], vx = m_vx[i], vy = m_vy[i];
+			const int32_t *ax = (plan > 0 ? &m_ax[thrust_index(i, 0)] : nullptr);
+			const int32_t *ay = (plan > 0 ? &m_ay[thrust_index(i, 0)] : nullptr);
+			auto fate = TrajectoryFate::ALIVE;
+			int32_t t = 0;
+			for(; t < plan; ++t){
+				fate = detail::trajectory_step<int32_t>(x, y, vx, vy, ax[t * LANES], ay[t * LANES], ur, gr);
+				if(fate != TrajectoryFate::ALIVE){ break; }
+			}
+			for(; fate == TrajectoryFate::ALIVE && t < steps; ++t){
+				fate = detail::trajectory_step<int32_t>(x, y, vx, vy, 0, 0, ur, gr);
+				if(fate != TrajectoryFate::ALIVE){ break; }
+			}
+			m_px[i] = x; m_py[i] = y; m_vx[i] = vx; m_vy[i] = vy;
+			m_fate[i] = static_cast<int32_t>(fate);
+			m_lifetime[i] += t;
+		}
+	}
+
+#ifdef __AVX2__
+	void run_avx2(int32_t steps, int32_t ur, int32_t gr){
+		alignas(32) int32_t lx[LANES], ly[LANES], lvx[LANES], lvy[LANES], lt[LANES], lid[LANES];
+		size_t next = 0;
+
+		// Candidate in a lane after lt[lane] steps: either dead or done
+		const auto write_back = [&](size_t lane){
+			const size_t i = lid[lane];
+			const int32_t r = std::max(std::abs(lx[lane]), std::abs(ly[lane]));
+			const bool escaped = (r > ur), crashed = (!escaped && r <= gr);
+			m_px[i] = lx[lane]; m_py[i] = ly[lane]; m_vx[i] = lvx[lane]; m_vy[i] = lvy[lane];
+			m_fate[i] = static_cast<int32_t>(escaped ? TrajectoryFate::ESCAPED
+			                                 : crashed ? TrajectoryFate::CRASHED
+			                                 : TrajectoryFate::ALIVE);
+			m_lifetime[i] += lt[lane] - (escaped || crashed ? 1 : 0);
+		};
+		// Loads the next live candidate into a lane, or marks the lane empty
+		const auto refill = [&](size_t lane){
+			while(next < m_size && m_fate[next] != static_cast<int32_t>(TrajectoryFate::ALIVE)){ ++next; }
+			if(next == m_size){
+				lx[lane] = ly[lane] = lvx[lane] = lvy[lane] = lt[lane] = 0;
+				lid[lane] = -1;
+				return;
+			}
+			lx[lane] = m_px[next]; ly[lane] = m_py[next]; lvx[lane] = m_vx[next]; lvy[lane] = m_vy[next];
+			lt[lane] = 0;
+			lid[lane] = static_cast<int32_t>(next++);
+		};
+
+		const auto load = [](const int32_t *p){ return _mm256_load_si256(reinterpret_cast<const __m256i*>(p)); };
+		const auto store = [](int32_t *p, __m256i v){ _mm256_store_si256(reinterpret_cast<__m256i*>(p), v); };
+		const __m256i zero = _mm256_setzero_si256();
+		const __m256i one = _mm256_set1_epi32(1);
+		const __m256i minus_one = _mm256_set1_epi32(-1);
+		const __m256i vur = _mm256_set1_epi32(ur);
+		const __m256i vgr = _mm256_set1_epi32(gr);
+		const __m256i vsteps = _mm256_set1_epi32(steps);
+		const __m256i vplan = _mm256_set1_epi32(std::min<int32_t>(steps, m_plan_length));
+		const __m256i plan_stride = _mm256_set1_epi32(static_cast<int32_t>(m_plan_length * LANES));
+		const __m256i lane_mask = _mm256_set1_epi32(LANES - 1);
+
+		for(size_t lane = 0; lane < LANES; ++lane){ refill(lane); }
+		__m256i x = load(lx), y = load(ly), vx = load(lvx), vy = load(lvy);
+		__m256i t = load(lt), id = load(lid);
+		__m256i active = _mm256_cmpgt_epi32(id, minus_one);
+		while(!_mm256_testz_si256(active, active)){
+			__m256i ax = zero, ay = zero;
+			if(m_plan_length > 0){
+				const __m256i planned = _mm256_and_si256(active, _mm256_cmpgt_epi32(vplan, t));
+				if(!_mm256_testz_si256(planned, planned)){
+					const __m256i index = _mm256_add_epi32(
+						_mm256_mullo_epi32(_mm256_srai_epi32(id, 3), plan_stride),
+						_mm256_add_epi32(_mm256_slli_epi32(t, 3), _mm256_and_si256(id, lane_mask)));
+					ax = _mm256_mask_i32gather_epi32(zero, m_ax.data(), index, planned, 4);
+					ay = _mm256_mask_i32gather_epi32(zero, m_ay.data(), index, planned, 4);
+				}
+			}
+			// Gravity: toward the planet along the dominant axes, with sign(0) = -1
+			const __m256i abs_x = _mm256_abs_epi32(x), abs_y = _mm256_abs_epi32(y);
+			const __m256i sx = _mm256_or_si256(_mm256_cmpgt_epi32(x, zero), one);
+			const __m256i sy = _mm256_or_si256(_mm256_cmpgt_epi32(y, zero), one);
+			const __m256i gx = _mm256_andnot_si256(_mm256_cmpgt_epi32(abs_y, abs_x), sx);
+			const __m256i gy = _mm256_andnot_si256(_mm256_cmpgt_epi32(abs_x, abs_y), sy);
+			vx = _mm256_sub_epi32(_mm256_add_epi32(vx, gx), ax);
+			vy = _mm256_sub_epi32(_mm256_add_epi32(vy, gy), ay);
+			x = _mm256_add_epi32(x, vx);
+			y = _mm256_add_epi32(y, vy);
+			t = _mm256_add_epi32(t, one);
+
+			// Lanes stay while gr < max(|x|, |y|) <= ur and steps remain
+			const __m256i r = _mm256_max_epi32(_mm256_abs_epi32(x), _mm256_abs_epi32(y));
+			const __m256i inside = _mm256_andnot_si256(_mm256_cmpgt_epi32(r, vur), _mm256_cmpgt_epi32(r, vgr));
+			const __m256i keep = _mm256_andnot_si256(_mm256_cmpeq_epi32(t, vsteps), inside);
+			const __m256i done = _mm256_andnot_si256(keep, active);
+			if(_mm256_testz_si256(done, done)){ continue; }
+
+			store(lx, x); store(ly, y); store(lvx, vx); store(lvy, vy);
+			store(lt, t); store(lid, id);
+			for(int mask = _mm256_movemask_ps(_mm256_castsi256_ps(done)); mask != 0; mask &= mask - 1){
+				const size_t lane = __builtin_ctz(mask);
+				write_back(lane);
+				refill(lane);
+			}
+			x = load(lx); y = load(ly); vx = load(lvx); vy = load(lvy);
+			t = load(lt); id = load(lid);
+			active = _mm256_cmpgt_epi32(id, minus_one);
+		}
+	}
+#endif
+
+public:
+	// `plan_length` is the number of leading steps that can be given thrust
+	explicit TrajectoryBatch(size_t plan_length = 0)
+		: m_size(0)
+		, m_plan_length(plan_length)
+		, m_px(), m_py(), m_vx(), m_vy()
+		, m_fate()
+		, m_lifetime()
+		, m_ax(), m_ay()
+	{ }
+
+	size_t size() const { return m_size; }
+	size_t plan_length() const { return m_plan_length; }
+
+	void clear(){
+		m_size = 0;
+		for(auto v : { &m_px, &m_py, &m_vx, &m_vy, &m_fate, &m_lifetime, &m_ax, &m_ay }){ v->clear(); }
+	}
+
+	void reserve(size_t n){
+		for(auto v : { &m_px, &m_py, &m_vx, &m_vy, &m_fate, &m_lifetime }){ v->reserve(n); }
+		const size_t padded = (n + LANES - 1) / LANES * LANES;
+		m_ax.reserve(padded * m_plan_length);
+		m_ay.reserve(padded * m_plan_length);
+	}
+
+	// Adds a candidate without thrust and returns its index
+	size_t add(const Vec& pos, const Vec& vel){
+		if(m_size >= static_cast<size_t>(INT32_MAX)){
+			throw std::runtime_error("too many trajectories");
+		}
+		if(m_size % LANES == 0){
+			m_ax.resize(m_ax.size() + LANES * m_plan_length, 0);
+			m_ay.resize(m_ay.size() + LANES * m_plan_length, 0);
+		}
+		m_px.push_back(narrow(pos.x));
+		m_py.push_back(narrow(pos.y));
+		m_vx.push_back(narrow(vel.x));
+		m_vy.push_back(narrow(vel.y));
+		m_fate.push_back(static_cast<int32_t>(TrajectoryFate::ALIVE));
+		m_lifetime.push_back(0);
+		return m_size++;
+	}
+
+	void set_thrust(size_t i, size_t step, const Vec& accel){
+		if(i >= m_size || step >= m_plan_length){
+			throw std::runtime_error("thrust out of range");
+		}
+		m_ax[thrust_index(i, step)] = narrow(accel.x);
+		m_ay[thrust_index(i, step)] = narrow(accel.y);
+	}
+
+	// Advances every live candidate by up to `steps` turns. Every run starts
+	// from the first step of the plan and steps past it have no thrust.
+	// A negative galaxy radius disables crashes.
+	void run(size_t steps, long universe_radius, long galaxy_radius){
+		if(steps == 0){ return; }
+		const int32_t n = clamp(steps), ur = clamp(universe_radius), gr = clamp(galaxy_radius);
+#ifdef __AVX2__
+		run_avx2(n, ur, gr);
+#else
+		run_scalar(n, ur, gr);
+#endif
+	}
+
+	Vec pos(size_t i) const { return Vec(m_px[i], m_py[i]); }
+	Vec vel(size_t i) const { return Vec(m_vx[i], m_vy[i]); }
+	TrajectoryFate fate(size_t i) const { return static_cast<TrajectoryFate>(m_fate[i]); }
+
+	// Turns survived over all runs so far
+	long lifetime(size_t i) const { return m_lifetime[i]; }
+
+};
+
+
+//----------------------------------------------------------------------------
+// Orbits
+//----------------------------------------------------------------------------
+struct OrbitInfo {
+	TrajectoryFate fate;
+	long           period;         // 0 unless the ship returns to its start state
+	long           lifetime;       // turns survived while classifying
+	long           min_clearance;  // min of max(|x|, |y|) - galaxy radius over live states
+	long           max_radius;     // max of max(|x|, |y|) over live states
+
+	OrbitInfo()
+		: fate(TrajectoryFate::ALIVE)
+		, period(0)
+		, lifetime(0)
+		, min_clearance(0)
+		, max_radius(0)
+	{ }
+
+	bool periodic() const { return period > 0; }
+};
+
+// Classifies coasting trajectories as periodic orbits, deaths or neither
+// within `max_period` turns.
+// Cycle detection follows Brent, with the tortoise parked at the start
+// state: a turn is invertible (see SurvivalTable), so a periodic state has
+// no lead-in and the period is the first return to the start. This takes
+// exactly `period` steps and no memory, and the clearance and radius are
+// gathered over the whole cycle in the same pass.
+class OrbitClassifier {
+
+private:
+	long m_universe_radius;
+	long m_galaxy_radius;
+	long m_max_period;
+
+public:
+	OrbitClassifier(long universe_radius, long galaxy_radius, long max_period = 256)
+		: m_universe_radius(universe_radius)
+		, m_galaxy_radius(galaxy_radius)
+		, m_max_period(max_period)
+	{ }
+
+	OrbitInfo operator()(const Vec& pos, const Vec& vel) const {
+		OrbitInfo info;
+		long x = pos.x, y = pos.y, vx = vel.x, vy = vel.y;
+		long r_min = std::max(std::abs(x), std::abs(y)), r_max = r_min;
+		for(long t = 1; t <= m_max_period; ++t){
+			info.fate = detail::trajectory_step<long>(
+				x, y, vx, vy, 0, 0, m_universe_radius, m_galaxy_radius);
+			if(info.fate != TrajectoryFate::ALIVE){ break; }
+			info.lifetime = t;
+			const long r = std::max(std::abs(x), std::abs(y));
+			r_min = std::min(r_min, r);
+			r_max = std::max(r_max, r);
+			if(x == pos.x && y == pos.y && vx == vel.x && vy == vel.y){
+				info.period = t;
+				break;
+			}
+		}
+		info.min_clearance = r_min - m_galaxy_radius;
+		info.max_radius = r_max;
+		return info;
+	}
+
+	// Classifies the current states of a batch; candidates that already
+	// died keep their fate and lifetime.
+	void operator()(const TrajectoryBatch& batch, std::vector<OrbitInfo>& out) const {
+		out.resize(batch.size());
+		for(size_t i = 0; i < batch.size(); ++i){
+			if(batch.fate(i) != TrajectoryFate::ALIVE){
+				out[i] = OrbitInfo();
+				out[i].fate = batch.fate(i);
+				out[i].lifetime = batch.lifetime(i);
+				continue;
+			}
+			out[i] = (*this)(batch.pos(i), batch.vel(i));
+			out[i].lifetime += batch.lifetime(i);
+		}
+	}
+
+};
+
+}
+
+#endif
@@ -3,7 +3,7 @@
 #include <random>
 #include <cmath>
 
-#include "galaxy.hpp"
+#include "galaxy_trajectory.hpp"
 
 
 //----------------------------------------------------------------------------
@@ -18,35 +18,12 @@ const int RELATIVE_ANGLE_THRESHOLD = 4;
 //----------------------------------------------------------------------------
 using Vec = galaxy::Vec;
 
-Vec gravity(const Vec p){
-	const long abs_x = std::abs(p.x), abs_y = std::abs(p.y);
-	if(abs_x > abs_y){
-		return Vec(p.x > 0 ? -1 : 1, 0);
-	}else if(abs_x < abs_y){
-		return Vec(0, p.y > 0 ? -1 : 1);
-	}else{
-		return Vec(p.x > 0 ? -1 : 1, p.y > 0 ? -1 : 1);
-	}
-}
-
-std::pair<Vec, Vec> simulate(const Vec& p0, const Vec& d0){
-	const Vec g = gravity(p0);
-	const Vec d(d0.x + g.x, d0.y + g.y);
-	const Vec p(p0.x + d.x, p0.y + d.y);
-	return std::make_pair(p, d);
-}
+using galaxy::rules::simulate;
 
+// Crashing into the planet is left to the caller
 bool universe_check(const Vec& p0, const Vec& d0, int n, long ur, long gr){
 	Vec p = p0, d = d0;
-	for(int i = 0; i < n; ++i){
-		const auto next = simulate(p, d);
-		if(std::abs(next.first.x) > ur){ return false; }
-		if(std::abs(next.first.y) > ur){ return false; }
-		if(std::abs(next.first.x) <= gr && std::abs(next.first.y) <= gr){ break; }
-		p = next.first;
-		d = next.second;
-	}
-	return true;
+	return galaxy::rules::trace(p, d, n, ur, gr) != galaxy::TrajectoryFate::ESCAPED;
 }
 
 Vec compute_accel(const Vec& p, const Vec& d, long ur, long gr){